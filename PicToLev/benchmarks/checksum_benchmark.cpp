@@ -0,0 +1,129 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Measures the throughput of the CRC-32 and Adler-32 kernels of lodepng.cpp and
+// of the byte-at-a-time table CRC and the scalar Adler-32 they replaced, on a
+// large random buffer. tests/checksum_test.cpp checks that they agree.
+// lodepng.cpp is included to reach its internal functions.
+//
+// Usage: run_benchmark.sh checksum [MIB [REPETITIONS]]
+// The buffer is 16 MiB and each kernel runs 10 times by default.
+
+#include "../src/lodepng.cpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+	// The original lodepng_crc32.
+	unsigned crc32_table(const unsigned char* data, std::size_t length) {
+		unsigned r = 0xffffffffu;
+		for (std::size_t i = 0; i != length; i++) {
+			r = lodepng_crc32_table[(r ^ data[i]) & 0xff] ^ (r >> 8);
+		}
+		return r ^ 0xffffffffu;
+	}
+
+	unsigned crc32_slices(const unsigned char* data, std::size_t length) {
+		return crc32_slicing8(0xffffffffu, data, length) ^ 0xffffffffu;
+	}
+
+#ifdef LODEPNG_SIMD_X86
+	// lodepng_crc32 with PCLMUL forced, as it is for lengths of 64 bytes and more.
+	unsigned crc32_pclmul(const unsigned char* data, std::size_t length) {
+		unsigned r = 0xffffffffu;
+		if (length >= 64) {
+			const std::size_t folded = length & ~std::size_t {15};
+			r = crc32_PCLMUL(r, data, folded);
+			data += folded;
+			length -= folded;
+		}
+		return crc32_slicing8(r, data, length) ^ 0xffffffffu;
+	}
+#endif
+
+	// The original update_adler32, now update_adler32_scalar.
+	unsigned adler32_scalar(const unsigned char* data, std::size_t length) {
+		return update_adler32_scalar(1, data, static_cast<unsigned>(length));
+	}
+
+#ifdef LODEPNG_SIMD_X86
+	unsigned adler32_sse2(const unsigned char* data, std::size_t length) {
+		return update_adler32_SSE2(1, data, static_cast<unsigned>(length));
+	}
+#endif
+
+	using checksum_function = unsigned (*)(const unsigned char*, std::size_t);
+
+	struct kernel {
+		const char* name;
+		checksum_function function;
+		unsigned required_features;
+	};
+
+	const kernel kernels[] = {
+		{"CRC-32 table", crc32_table, 0},
+		{"CRC-32 slicing-by-8", crc32_slices, 0},
+#ifdef LODEPNG_SIMD_X86
+		{"CRC-32 PCLMUL", crc32_pclmul, LODEPNG_CPU_PCLMUL},
+#endif
+		{"CRC-32 lodepng_crc32", lodepng_crc32, 0},
+		{"Adler-32 scalar", adler32_scalar, 0},
+#ifdef LODEPNG_SIMD_X86
+		{"Adler-32 SSE2", adler32_sse2, LODEPNG_CPU_SSE2},
+#endif
+	};
+}
+
+int main(int argc, char* argv[]) {
+	const std::size_t size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) << 20 : std::size_t {16} << 20;
+	const int repetitions = argc > 2 ? std::atoi(argv[2]) : 10;
+	std::mt19937 random(2018);
+	std::vector<unsigned char> buffer(size + 64);
+	for (auto& value : buffer) {
+		value = static_cast<unsigned char>(random());
+	}
+	const unsigned supported = lodepng_cpu_features();
+	std::cout << "Throughput on " << (size >> 20) << " MiB, best of " << repetitions << " runs:" << std::endl;
+	for (const auto& k : kernels) {
+		if ((k.required_features & supported) != k.required_features) {
+			std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+			continue;
+		}
+		double best = 0;
+		volatile unsigned sink = 0;
+		for (int i = 0; i != repetitions; i++) {
+			const auto start = std::chrono::steady_clock::now();
+			sink = sink + k.function(buffer.data(), size);
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = std::max(best, size / elapsed.count() / 1e9);
+		}
+		std::cout << "  " << k.name << ": " << best << " GB/s" << std::endl;
+	}
+	return 0;
+}
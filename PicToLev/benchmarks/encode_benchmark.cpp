@@ -0,0 +1,218 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Measures single-threaded lodepng::encode throughput on tileset images, in MB
+// of filtered image data per second, and the ratio of the output size to that
+// data. Each image is encoded as an unfiltered 8-bit palette PNG, like PicToLev
+// writes its tilesets, and the output is decoded again and checked.
+// lodepng.cpp and compression_level.cpp are included because run_benchmark.sh
+// only builds the benchmark and the allocator.
+//
+// Usage: run_benchmark.sh encode [OPTIONS] TILESET...
+//   -r N     encodes every image N times and keeps the fastest run (default 3)
+//   -p LIST  measures the comma-separated --level presets in turn, exactly as
+//            PicToLev encodes at them; the options below are then ignored
+//   -w N     LZ77 window size (default 2048)
+//   -c N     maximum hash chain length, 0 to derive it from the window (default 0)
+//   -n N     length at which a match is taken without trying others (default 128)
+//   -m N     minimum match length (default 3)
+//   -l 0|1   lazy matching (default 1)
+// The tilesets of a level made by make_level.py serve as the corpus:
+//   make_level.py 120 80 --art --output corpus && pictolev corpus-img.png corpus-mask.png
+//   run_benchmark.sh encode -p store,fast,default,max corpus-img-output-1.png corpus-mask-output-2.png
+
+#include "../src/compression_level.cpp"
+#include "../src/lodepng.cpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+	struct benchmark_options {
+		int repetitions = 3;
+		LodePNGCompressSettings zlib;
+		// Presets measured in turn in place of the settings in zlib.
+		std::vector<compression_level> levels;
+		std::vector<std::string> filenames;
+	};
+
+	struct tileset {
+		std::string filename;
+		std::vector<unsigned char> image;
+		unsigned width;
+		unsigned height;
+		lodepng::State state;
+	};
+
+	bool parse_levels(std::string_view list, std::vector<compression_level>& levels) {
+		while (!list.empty()) {
+			const std::string_view name = list.substr(0, list.find(','));
+			list.remove_prefix(std::min(list.size(), name.size() + 1));
+			const auto it = std::find_if(compression_level_names.begin(), compression_level_names.end(),
+				[name](const auto& entry) { return entry.first == name; });
+			if (it == compression_level_names.end())
+				return false;
+			levels.push_back(it->second);
+		}
+		return !levels.empty();
+	}
+
+	bool parse_arguments(int argc, char* argv[], benchmark_options& options) {
+		lodepng_compress_settings_init(&options.zlib);
+		for (int i = 1; i < argc; i++) {
+			const std::string_view argument(argv[i]);
+			if (argument.size() != 2 || argument[0] != '-') {
+				options.filenames.emplace_back(argument);
+				continue;
+			}
+			if (++i == argc)
+				return false;
+			if (argument[1] == 'p') {
+				if (!parse_levels(argv[i], options.levels))
+					return false;
+				continue;
+			}
+			const unsigned value = static_cast<unsigned>(std::strtoul(argv[i], nullptr, 10));
+			switch (argument[1]) {
+			case 'r':
+				options.repetitions = static_cast<int>(value);
+				break;
+			case 'w':
+				options.zlib.windowsize = value;
+				break;
+			case 'c':
+				options.zlib.maxchainlength = value;
+				break;
+			case 'n':
+				options.zlib.nicematch = value;
+				break;
+			case 'm':
+				options.zlib.minmatch = value;
+				break;
+			case 'l':
+				options.zlib.lazymatching = value;
+				break;
+			default:
+				return false;
+			}
+		}
+		return !options.filenames.empty() && options.repetitions > 0;
+	}
+
+	bool load_tileset(const std::string& filename, tileset& result) {
+		std::vector<unsigned char> file;
+		result.filename = filename;
+		result.state.decoder.color_convert = false;
+		unsigned error = lodepng::load_file(file, filename);
+		if (error == 0)
+			error = lodepng::decode(result.image, result.width, result.height, result.state, file);
+		if (error == 0 && (result.state.info_png.color.colortype != LCT_PALETTE || result.state.info_png.color.bitdepth != 8))
+			error = 56;
+		if (error != 0) {
+			std::cerr << filename << ": " << lodepng_error_text(error) << std::endl;
+			return false;
+		}
+		result.state.encoder.auto_convert = false;
+		result.state.encoder.filter_palette_zero = true;
+		result.state.info_raw.colortype = LCT_PALETTE;
+		return true;
+	}
+
+	// Encodes every tileset with the given settings, or at the given level, and
+	// prints the results. Returns false if an output does not decode to its input.
+	bool measure(std::vector<tileset>& tilesets, const benchmark_options& options, std::optional<compression_level> level) {
+		double total_input = 0;
+		std::size_t total_output = 0;
+		double total_seconds = 0;
+		for (auto& tileset : tilesets) {
+			tileset.state.encoder.zlibsettings = options.zlib;
+			std::vector<unsigned char> output;
+			double best = 0;
+			for (int i = 0; i != options.repetitions; i++) {
+				output.clear();
+				const auto start = std::chrono::steady_clock::now();
+				const unsigned error = level ?
+					encode_at_level(output, tileset.image, tileset.width, tileset.height, tileset.state, *level) :
+					lodepng::encode(output, tileset.image, tileset.width, tileset.height, tileset.state);
+				const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				if (error != 0) {
+					std::cerr << tileset.filename << ": " << lodepng_error_text(error) << std::endl;
+					return false;
+				}
+				best = i == 0 ? elapsed.count() : std::min(best, elapsed.count());
+			}
+			std::vector<unsigned char> decoded;
+			unsigned width;
+			unsigned height;
+			lodepng::State check_state;
+			check_state.decoder.color_convert = false;
+			if (lodepng::decode(decoded, width, height, check_state, output) != 0 || decoded != tileset.image) {
+				std::cerr << tileset.filename << ": the encoded image does not decode to the original" << std::endl;
+				return false;
+			}
+			// Every row is preceded by its filter type byte.
+			const double input = static_cast<double>(tileset.width + 1) * tileset.height;
+			std::cout << "  " << tileset.filename << ": " << output.size() << " bytes, " << input / best / 1e6 << " MB/s" << std::endl;
+			total_input += input;
+			total_output += output.size();
+			total_seconds += best;
+		}
+		std::cout << "  total: " << total_output << " bytes, " << total_input / total_seconds / 1e6 << " MB/s, ratio ";
+		std::cout << static_cast<double>(total_output) / total_input << std::endl;
+		return true;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	benchmark_options options;
+	if (!parse_arguments(argc, argv, options)) {
+		std::cerr << "Usage: " << argv[0] << " [-r N] [-p LIST] [-w N] [-c N] [-n N] [-m N] [-l 0|1] TILESET..." << std::endl;
+		return 1;
+	}
+	std::vector<tileset> tilesets(options.filenames.size());
+	for (std::size_t i = 0; i != tilesets.size(); i++) {
+		if (!load_tileset(options.filenames[i], tilesets[i]))
+			return 1;
+	}
+	if (options.levels.empty()) {
+		std::cout << "window " << options.zlib.windowsize << ", chain " << options.zlib.maxchainlength;
+		std::cout << ", nice " << options.zlib.nicematch << ", min " << options.zlib.minmatch;
+		std::cout << ", lazy " << options.zlib.lazymatching << ':' << std::endl;
+		return measure(tilesets, options, std::nullopt) ? 0 : 1;
+	}
+	for (const compression_level level : options.levels) {
+		const auto name = std::find_if(compression_level_names.begin(), compression_level_names.end(),
+			[level](const auto& entry) { return entry.second == level; })->first;
+		std::cout << "--level=" << name << ':' << std::endl;
+		if (!measure(tilesets, options, level))
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+# Generates a pair of 8-bit palette PNGs to feed PicToLev and the benchmarks: an
+# image of tiles picked at random from a set of distinct 32x32 tiles, with most
+# grid cells left empty, and its mask, which is 1 wherever the image is not 0.
+# With --art, the tiles are cut from sheets painted like tileset art, with
+# shaded shapes, bricks and dithered ground over a transparent background, and
+# the level is made of blocks of neighbouring tiles; without it, they are noise.
+# The output is deterministic for a given seed.
+#
+# Usage: make_level.py WIDTH HEIGHT [--tiles N] [--empty FRACTION] [--art] [--seed S] [--output PREFIX]
+# WIDTH and HEIGHT are in tiles. Writes PREFIX-img.png and PREFIX-mask.png.
+
+import argparse
+import random
+import struct
+import zlib
+
+TILE_SIZE = 32
+# Width and height in tiles of the sheets that --art cuts tiles from.
+SHEET_SIZE = 8
+
+
+def write_png(path, width, height, rows):
+    def chunk(kind, data):
+        return struct.pack('>I', len(data)) + kind + data + struct.pack('>I', zlib.crc32(kind + data))
+
+    palette = b''.join(bytes([(i * 37) & 255, (i * 91) & 255, (i * 13) & 255]) for i in range(256))
+    compressor = zlib.compressobj(1)
+    data = b''.join(compressor.compress(b'\0' + row) for row in rows) + compressor.flush()
+    with open(path, 'wb') as file:
+        file.write(b'\x89PNG\r\n\x1a\n')
+        file.write(chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 3, 0, 0, 0)))
+        file.write(chunk(b'PLTE', palette))
+        file.write(chunk(b'IDAT', data))
+        file.write(chunk(b'IEND', b''))
+
+
+def noise_tiles(generator, count):
+    tiles = []
+    for _ in range(count):
+        image = [bytes(generator.choice([0, generator.randrange(256)]) for _ in range(TILE_SIZE))
+                 for _ in range(TILE_SIZE)]
+        tiles.append(image)
+    return tiles
+
+
+def paint_sheet(generator, size):
+    """Paints a sheet of size x size tiles. Every shape is shaded with a ramp of 8
+    consecutive palette entries, and 0 is left for the background."""
+    width = size * TILE_SIZE
+    pixels = [bytearray(width) for _ in range(width)]
+    for _ in range(generator.randint(4, 8)):
+        ramp = generator.randrange(1, 32) * 8
+        kind = generator.choice(('gradient', 'bricks', 'ground', 'blob'))
+        x0, y0 = generator.randrange(width), generator.randrange(width)
+        x1, y1 = min(width, x0 + generator.randint(24, width)), min(width, y0 + generator.randint(24, width))
+        if kind == 'blob':
+            radius = generator.randint(8, 60)
+            for y in range(max(0, y0 - radius), min(width, y0 + radius)):
+                for x in range(max(0, x0 - radius), min(width, x0 + radius)):
+                    distance = ((x - x0) ** 2 + (y - y0) ** 2) ** 0.5
+                    if distance < radius:
+                        pixels[y][x] = ramp if distance > radius - 1.5 else ramp + 7 - int(6 * distance / radius)
+            continue
+        slope = generator.uniform(-0.5, 0.5)
+        for y in range(y0, y1):
+            for x in range(x0, x1):
+                if kind == 'gradient':
+                    pixels[y][x] = ramp + (y - y0) * 8 // (y1 - y0)
+                elif kind == 'bricks':
+                    row, column = (y - y0) // 8, (x - x0 + (y - y0) // 8 % 2 * 8) // 16
+                    edge = (y - y0) % 8 == 0 or (x - x0 + row % 2 * 8) % 16 == 0
+                    pixels[y][x] = ramp if edge else ramp + 3 + (row * 7 + column * 3) % 3
+                else:
+                    depth = y - y0 - int(slope * (x - x0))
+                    if depth >= 0:
+                        pixels[y][x] = ramp + 6 if depth < 3 else ramp + 1 + (x + y) % 2 + min(depth // 8, 4)
+    return pixels
+
+
+def art_tiles(generator, count):
+    """Cuts whole sheets into tiles in reading order, so that tiles continue
+    their neighbours, until there are at least count tiles."""
+    tiles = []
+    while len(tiles) < count:
+        sheet = paint_sheet(generator, SHEET_SIZE)
+        for y in range(0, len(sheet), TILE_SIZE):
+            for x in range(0, len(sheet), TILE_SIZE):
+                tiles.append([bytes(row[x:x + TILE_SIZE]) for row in sheet[y:y + TILE_SIZE]])
+    return tiles
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('width', type=int, help='width in tiles')
+    parser.add_argument('height', type=int, help='height in tiles')
+    parser.add_argument('--tiles', type=int, default=1500, help='number of distinct non-empty tiles')
+    parser.add_argument('--empty', type=float, default=0.6, help='fraction of empty grid cells')
+    parser.add_argument('--art', action='store_true', help='cut the tiles from painted sheets')
+    parser.add_argument('--seed', type=int, default=5)
+    parser.add_argument('--output', default='level', help='prefix of the output files')
+    args = parser.parse_args()
+
+    generator = random.Random(args.seed)
+    empty_row = bytes(TILE_SIZE)
+    tiles = [([empty_row] * TILE_SIZE, [empty_row] * TILE_SIZE)]
+    images = art_tiles(generator, args.tiles) if args.art else noise_tiles(generator, args.tiles)
+    for image in images:
+        mask = [bytes(1 if value else 0 for value in row) for row in image]
+        tiles.append((image, mask))
+    if not args.art:
+        grid = [[0 if generator.random() < args.empty else generator.randrange(1, len(tiles))
+                 for _ in range(args.width)] for _ in range(args.height)]
+    else:
+        # Blocks of up to 4x4 neighbouring tiles of a sheet, placed until the
+        # level is as full as asked.
+        grid = [[0] * args.width for _ in range(args.height)]
+        for _ in range(int(args.width * args.height * (1 - args.empty) / 6)):
+            width, height = generator.randint(1, 4), generator.randint(1, 4)
+            sheet = generator.randrange(len(images) // (SHEET_SIZE * SHEET_SIZE))
+            sheet_x, sheet_y = generator.randrange(SHEET_SIZE - width + 1), generator.randrange(SHEET_SIZE - height + 1)
+            x, y = generator.randrange(args.width), generator.randrange(args.height)
+            for row in range(min(height, args.height - y)):
+                for column in range(min(width, args.width - x)):
+                    grid[y + row][x + column] = 1 + (sheet * SHEET_SIZE + sheet_y + row) * SHEET_SIZE + sheet_x + column
+
+    for index, suffix in ((0, 'img'), (1, 'mask')):
+        rows = (b''.join(tiles[tile][index][y] for tile in grid_row) for grid_row in grid for y in range(TILE_SIZE))
+        write_png('%s-%s.png' % (args.output, suffix), args.width * TILE_SIZE, args.height * TILE_SIZE, rows)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Compares the two ways of splitting a decoded image into tiles and finding its
+// distinct tiles: views straight into the row-major image, and views into a copy
+// repacked by repack_tiles so that every tile is contiguous. Each path is timed
+// from the decoded image to the filled dictionary, best of the repetitions, and
+// both must find the same tile IDs. Wide levels are where the strided views
+// suffer, as the rows of one tile lie a whole image row apart.
+// lodepng.cpp is included because run_benchmark.sh only builds the benchmark
+// and the allocator.
+//
+// Usage: run_benchmark.sh repack IMAGE... [-r REPETITIONS]
+// Suitable inputs are made by make_level.py, for example:
+//   make_level.py 1024 64 --output wide && run_benchmark.sh repack wide-img.png wide-mask.png
+
+#include "../src/lodepng.cpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <gsl/span>
+#include "container_hash.h"
+#include "grid_size.h"
+#include "tile_dictionary.h"
+#include "tiles.h"
+
+namespace {
+	constexpr std::size_t tile_size = 32;
+	using tile_t = tile_view<const unsigned char, tile_size>;
+	using dictionary_t = tile_dictionary<tile_t, container_word_hash>;
+	using clock = std::chrono::steady_clock;
+
+	struct timing {
+		double split = 0;
+		double dedup = 0;
+	};
+
+	double seconds_since(clock::time_point start) {
+		return std::chrono::duration<double>(clock::now() - start).count();
+	}
+
+	std::vector<dictionary_t::id_type> find_ids(const tile_vector<const unsigned char, tile_size>& tiles, timing& time, clock::time_point start) {
+		dictionary_t dictionary(tiles.size() / 4);
+		std::vector<dictionary_t::id_type> ids;
+		ids.reserve(tiles.size());
+		for (const auto& tile : tiles) {
+			ids.push_back(dictionary.emplace(tile, [](const tile_t& stored, dictionary_t::id_type) { return stored; }).first);
+		}
+		time.dedup = seconds_since(start);
+		return ids;
+	}
+
+	std::vector<dictionary_t::id_type> strided(const std::vector<unsigned char>& image, grid_size size, timing& time) {
+		const auto start = clock::now();
+		const auto tiles = buffer_to_tile_list<tile_size>(gsl::make_span(image), size);
+		const auto split_end = clock::now();
+		time.split = std::chrono::duration<double>(split_end - start).count();
+		return find_ids(tiles, time, split_end);
+	}
+
+	std::vector<dictionary_t::id_type> repacked(const std::vector<unsigned char>& image, grid_size size, timing& time) {
+		const auto start = clock::now();
+		std::vector<unsigned char> packed(image.size());
+		repack_tiles<tile_size>(gsl::make_span(image), size, gsl::make_span(packed));
+		const auto tiles = packed_buffer_to_tile_list<tile_size>(gsl::make_span(std::as_const(packed)));
+		const auto split_end = clock::now();
+		time.split = std::chrono::duration<double>(split_end - start).count();
+		return find_ids(tiles, time, split_end);
+	}
+
+	void keep_best(timing& best, const timing& time) {
+		if (best.split == 0 || time.split + time.dedup < best.split + best.dedup)
+			best = time;
+	}
+
+	void print(std::string_view name, const timing& time) {
+		std::cout << "  " << name << ": " << (time.split + time.dedup) * 1e3 << " ms (split ";
+		std::cout << time.split * 1e3 << " ms, dictionary " << time.dedup * 1e3 << " ms)" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	int repetitions = 10;
+	std::vector<std::string> filenames;
+	for (int i = 1; i < argc; i++) {
+		if (std::string_view(argv[i]) == "-r" && i + 1 < argc)
+			repetitions = std::atoi(argv[++i]);
+		else
+			filenames.emplace_back(argv[i]);
+	}
+	if (filenames.empty() || repetitions < 1) {
+		std::cerr << "Usage: " << argv[0] << " IMAGE... [-r REPETITIONS]" << std::endl;
+		return 1;
+	}
+	int result = 0;
+	for (const auto& filename : filenames) {
+		std::vector<unsigned char> file;
+		std::vector<unsigned char> image;
+		unsigned width;
+		unsigned height;
+		lodepng::State state;
+		state.decoder.color_convert = false;
+		unsigned error = lodepng::load_file(file, filename);
+		if (error == 0)
+			error = lodepng::decode(image, width, height, state, file);
+		if (error == 0 && (state.info_png.color.colortype != LCT_PALETTE || state.info_png.color.bitdepth != 8))
+			error = 56;
+		if (error != 0) {
+			std::cerr << filename << ": " << lodepng_error_text(error) << std::endl;
+			result = 1;
+			continue;
+		}
+		if (width % tile_size != 0 || height % tile_size != 0) {
+			std::cerr << filename << ": dimensions are not multiples of " << tile_size << std::endl;
+			result = 1;
+			continue;
+		}
+		const grid_size size {width, height};
+		timing best_strided;
+		timing best_repacked;
+		std::vector<dictionary_t::id_type> strided_ids;
+		std::vector<dictionary_t::id_type> repacked_ids;
+		for (int i = 0; i != repetitions; i++) {
+			timing time;
+			strided_ids = strided(image, size, time);
+			keep_best(best_strided, time);
+			repacked_ids = repacked(image, size, time);
+			keep_best(best_repacked, time);
+		}
+		const auto distinct = strided_ids.empty() ? 0 : *std::max_element(strided_ids.begin(), strided_ids.end()) + 1;
+		std::cout << filename << ": " << width / tile_size << "x" << height / tile_size << " tiles, ";
+		std::cout << distinct << " distinct, best of " << repetitions << " runs" << std::endl;
+		if (strided_ids != repacked_ids) {
+			std::cerr << "  the repacked tiles were assigned different IDs" << std::endl;
+			result = 1;
+			continue;
+		}
+		print("strided", best_strided);
+		print("repacked", best_repacked);
+	}
+	return result;
+}
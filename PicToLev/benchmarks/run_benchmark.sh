@@ -0,0 +1,19 @@
+#!/bin/sh
+# Usage: run_benchmark.sh NAME [ARGUMENTS...]
+# Builds NAME_benchmark.cpp from this directory with the compiler in CXX and runs
+# it with the given arguments. See the comment at the top of each benchmark for
+# its arguments.
+set -e
+if [ $# -lt 1 ]; then
+	echo "Usage: $0 NAME [ARGUMENTS...]" >&2
+	exit 1
+fi
+name=$1
+shift
+cd "$(dirname "$0")"
+CXX=${CXX:-c++}
+BUILD_DIR=${BUILD_DIR:-${TMPDIR:-/tmp}/pictolev-benchmarks}
+mkdir -p "$BUILD_DIR"
+$CXX -std=c++17 -O2 -pthread -I../include $CXXFLAGS "${name}_benchmark.cpp" ../src/lodepng_arena.cpp -o "$BUILD_DIR/$name"
+cd - >/dev/null
+"$BUILD_DIR/$name" "$@"
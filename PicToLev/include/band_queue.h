@@ -0,0 +1,86 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef PICTOLEV_BAND_QUEUE_H
+#define PICTOLEV_BAND_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Bounded single-producer single-consumer queue of image bands. The producer
+// blocks while the queue is full, so at most capacity bands are buffered.
+class band_queue {
+public:
+	using band_type = std::vector<unsigned char>;
+	explicit band_queue(std::size_t capacity) : capacity(capacity) {}
+	// Returns false if the consumer has stopped listening.
+	bool push(band_type band) {
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this]() { return bands.size() < capacity || aborted; });
+		if (aborted)
+			return false;
+		bands.push_back(std::move(band));
+		not_empty.notify_one();
+		return true;
+	}
+	// Returns nothing once the producer has finished and the queue is empty.
+	std::optional<band_type> pop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this]() { return !bands.empty() || closed; });
+		if (bands.empty())
+			return std::nullopt;
+		band_type band = std::move(bands.front());
+		bands.pop_front();
+		not_full.notify_one();
+		return band;
+	}
+	// Called by the producer after its last band.
+	void close() {
+		const std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		not_empty.notify_all();
+	}
+	// Called by the consumer to release a producer blocked in push.
+	void abort() {
+		const std::lock_guard<std::mutex> lock(mutex);
+		aborted = true;
+		bands.clear();
+		not_full.notify_all();
+	}
+private:
+	std::mutex mutex;
+	std::condition_variable not_full;
+	std::condition_variable not_empty;
+	std::deque<band_type> bands;
+	std::size_t capacity;
+	bool closed = false;
+	bool aborted = false;
+};
+
+#endif
@@ -26,11 +26,14 @@
 #define PICTOLEV_BINARY_SERIALIZATION_H
 
 #include <algorithm>
+#include <cstddef>
 #include <iterator>
 #include <limits>
 #include <ostream>
 #include <type_traits>
+#include <vector>
 #include <gsl/gsl_util>
+#include <gsl/span>
 
 enum class endian {
 #ifdef _WIN32
@@ -73,4 +76,30 @@ write_binary(std::ostream& stream, T value) {
 	write_buffer(stream, buffer);
 }
 
+// Writes all values with a single call to write. Values in the native byte
+// order are written straight from memory; others are converted into a buffer
+// first, with shifts that compilers turn into byte swap instructions.
+template<endian Endian, typename T>
+std::enable_if_t<std::is_integral_v<std::remove_const_t<T>>>
+write_binary(std::ostream& stream, gsl::span<T> values) {
+	static_assert(Endian == endian::little || Endian == endian::big);
+	constexpr std::size_t size = sizeof(T);
+	const auto byte_count = gsl::narrow_cast<std::size_t>(values.size_bytes());
+	if constexpr (Endian == endian::native || size == 1) {
+		stream.write(reinterpret_cast<const char*>(values.data()), gsl::narrow_cast<std::streamsize>(byte_count));
+	} else {
+		std::vector<char> buffer(byte_count);
+		char* out = buffer.data();
+		for (const auto value : values) {
+			const std::make_unsigned_t<std::remove_const_t<T>> u_value = value;
+			for (std::size_t i = 0; i != size; i++) {
+				const std::size_t position = Endian == endian::little ? i : size - 1 - i;
+				out[position] = static_cast<char>(gsl::narrow_cast<unsigned char>(u_value >> (i * std::numeric_limits<unsigned char>::digits)));
+			}
+			out += size;
+		}
+		stream.write(buffer.data(), gsl::narrow_cast<std::streamsize>(byte_count));
+	}
+}
+
 #endif
@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef PICTOLEV_COMPRESSION_LEVEL_H
+#define PICTOLEV_COMPRESSION_LEVEL_H
+
+#include <array>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <lodepng.h>
+
+// Presets of the deflate settings of the output images, from the fastest to the
+// most thorough.
+enum class compression_level {
+	store,
+	fast,
+	normal,
+	max,
+};
+
+constexpr std::array<std::pair<std::string_view, compression_level>, 4> compression_level_names {{
+	{"store", compression_level::store},
+	{"fast", compression_level::fast},
+	{"default", compression_level::normal},
+	{"max", compression_level::max},
+}};
+
+// Sets the deflate settings of the level; other settings are left as they are.
+void set_compression_level(LodePNGEncoderSettings& encoder, compression_level level);
+
+// Encodes the image with the settings of the state at the given level, into out.
+// Overwrites the deflate settings of the state, and returns a lodepng error code.
+unsigned encode_at_level(std::vector<unsigned char>& out, const std::vector<unsigned char>& image, unsigned width, unsigned height,
+	lodepng::State& state, compression_level level);
+
+#endif
@@ -26,45 +26,49 @@
 #define PICTOLEV_CONTAINER_HASH_H
 
 #include <cstddef>
-#include <functional>
+#include <cstdint>
 #include <iterator>
-#include <numeric>
 #include <utility>
 #include <type_traits>
 #include "container_traits.h"
+#include "word_hash.h"
 
-template<class T, class Hash, class = void>
-struct container_hash {
-	container_hash(const container_hash&) = delete;
-	container_hash& operator=(const container_hash&) = delete;
-};
-
-template<class T, class Hash>
-struct container_hash<T, Hash, std::enable_if_t<is_iterable_t<T>>> {
-	std::size_t operator()(const T& container) const {
-		using value_type = typename container_iterator_traits<T>::value_type;
-		return std::accumulate(
-			std::begin(container),
-			std::end(container),
-			std::size_t(),
-			[hash = Hash()](std::size_t seed, const value_type& value) {
-				return seed ^ (hash(value) + 0x9E3779B9 + (seed << 6) + (seed >> 2));
+// Hashes the bytes of all elements of a possibly nested container, in order,
+// with word_hasher. Contiguous ranges are consumed as whole words, and the
+// result does not depend on how the elements are grouped, so a strided tile and
+// a contiguous copy of it hash to the same value. Leaf elements must be equal
+// exactly when their object representations are.
+struct container_word_hash {
+	template<class T>
+	std::uint64_t operator()(const T& value) const noexcept {
+		word_hasher hasher;
+		update(hasher, value);
+		return hasher.digest();
+	}
+private:
+	template<class T, class = void>
+	struct is_contiguous_range : std::false_type {};
+	template<class T>
+	struct is_contiguous_range<T, std::enable_if_t<std::is_same_v<
+		std::remove_cv_t<std::remove_pointer_t<decltype(std::data(std::declval<const T&>()))>>,
+		std::remove_cv_t<typename container_iterator_traits<T>::value_type>
+	>>> : std::true_type {};
+	template<class T>
+	static constexpr bool is_contiguous_leaf = !is_iterable_t<const T&> && std::has_unique_object_representations_v<std::remove_cv_t<T>>;
+	template<class T>
+	static void update(word_hasher& hasher, const T& value) noexcept {
+		if constexpr (!is_iterable_t<const T&>) {
+			static_assert(std::has_unique_object_representations_v<T>, "Hashed elements must have unique object representations");
+			hasher.update(reinterpret_cast<const unsigned char*>(&value), sizeof(value));
+		} else if constexpr (is_contiguous_range<T>::value && is_contiguous_leaf<typename container_iterator_traits<T>::value_type>) {
+			using value_type = typename container_iterator_traits<T>::value_type;
+			hasher.update(reinterpret_cast<const unsigned char*>(std::data(value)), static_cast<std::size_t>(std::size(value)) * sizeof(value_type));
+		} else {
+			for (const auto& element : value) {
+				update(hasher, element);
 			}
-		);
+		}
 	}
 };
 
-template<class T, class Hash, class = void>
-struct container_deep_hash {
-	using type = Hash;
-};
-
-template<class T, class Hash>
-struct container_deep_hash<T, Hash, std::enable_if_t<is_iterable_t<T>>> {
-	using type = container_hash<T, typename container_deep_hash<typename T::value_type, Hash>::type>;
-};
-
-template<class T, class Hash>
-using container_deep_hash_t = typename container_deep_hash<T, Hash>::type;
-
 #endif
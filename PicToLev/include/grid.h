@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef PICTOLEV_GRID_H
+#define PICTOLEV_GRID_H
+
+#include <cstddef>
+#include <vector>
+#include <gsl/gsl_assert>
+#include <gsl/gsl_util>
+#include <gsl/span>
+#include "grid_size.h"
+
+// A column of a grid, as a view of every stride-th element.
+template<class T>
+class grid_column {
+public:
+	constexpr grid_column(T* data, std::size_t stride, std::size_t size) noexcept : first(data), stride(stride), count(size) {}
+	constexpr std::size_t size() const noexcept {
+		return count;
+	}
+	constexpr T& operator[](std::size_t y) const {
+		Expects(y < count);
+		return first[y * stride];
+	}
+private:
+	T* first;
+	std::size_t stride;
+	std::size_t count;
+};
+
+// A two-dimensional array stored contiguously in row-major order. Every row is
+// padded with value-initialized elements to a multiple of the row alignment,
+// and the padding is only reachable through elements.
+template<class T>
+class grid {
+public:
+	grid() = default;
+	explicit grid(grid_size size, std::size_t row_alignment = 1) :
+		logical_size(size),
+		row_stride((size.width + row_alignment - 1) / row_alignment * row_alignment),
+		storage(row_stride * size.height) {}
+
+	grid_size size() const noexcept {
+		return logical_size;
+	}
+	// Elements from the start of one row to the start of the next.
+	std::size_t stride() const noexcept {
+		return row_stride;
+	}
+	gsl::span<T> row(std::size_t y) {
+		Expects(y < logical_size.height);
+		return {storage.data() + y * row_stride, gsl::narrow_cast<std::ptrdiff_t>(logical_size.width)};
+	}
+	gsl::span<const T> row(std::size_t y) const {
+		Expects(y < logical_size.height);
+		return {storage.data() + y * row_stride, gsl::narrow_cast<std::ptrdiff_t>(logical_size.width)};
+	}
+	grid_column<T> column(std::size_t x) {
+		Expects(x < logical_size.width);
+		return {storage.data() + x, row_stride, logical_size.height};
+	}
+	grid_column<const T> column(std::size_t x) const {
+		Expects(x < logical_size.width);
+		return {storage.data() + x, row_stride, logical_size.height};
+	}
+	// All elements including the padding, row after row.
+	gsl::span<T> elements() noexcept {
+		return storage;
+	}
+	gsl::span<const T> elements() const noexcept {
+		return storage;
+	}
+private:
+	grid_size logical_size {0, 0};
+	std::size_t row_stride = 0;
+	std::vector<T> storage;
+};
+
+#endif
@@ -70,9 +70,16 @@ the custom_zlib field of the compress and decompress settings*/
 #endif
 /*Compile the default allocators (C's free, malloc and realloc). If you disable this,
 you can define the functions lodepng_free, lodepng_malloc and lodepng_realloc in your
-source files with custom allocators.*/
+source files with custom allocators.
+PicToLev defines them in lodepng_arena.cpp and frees lodepng's buffers with them, so
+they are always disabled here, whatever the build passes to the compiler.*/
 #ifndef LODEPNG_NO_COMPILE_ALLOCATORS
-#define LODEPNG_COMPILE_ALLOCATORS
+#define LODEPNG_NO_COMPILE_ALLOCATORS
+#endif
+/*use SSE2 and AVX2 instructions where the compiler and CPU support them.
+AVX2 is detected at runtime, SSE2 is used when the compiler targets it.*/
+#ifndef LODEPNG_NO_COMPILE_SIMD
+#define LODEPNG_COMPILE_SIMD
 #endif
 /*compile the C++ version (you can disable the C++ wrapper here even when compiling for C++)*/
 #ifdef __cplusplus
@@ -291,6 +298,9 @@ struct LodePNGCompressSettings /*deflate = compress*/
   unsigned minmatch; /*mininum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+  /*most hash chain entries searched per position, lower is faster. 0 searches windowsize entries,
+  or windowsize / 8 if windowsize is below 8192. Default: 0*/
+  unsigned maxchainlength;
 
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -655,6 +665,18 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize);
 
+/*
+Same as lodepng_decode, but decodes into the caller-owned buffer out of outsize bytes
+instead of allocating one. outsize must be at least lodepng_get_raw_size of the image
+in the output color mode: info_raw, or the PNG's own color type from lodepng_inspect
+if decoder.color_convert is disabled. If no color conversion is needed the scanlines
+are unfiltered straight into out, otherwise a temporary buffer is used for them.
+Returns error 97 if out is too small.
+*/
+unsigned lodepng_decode_into(unsigned char* out, size_t outsize, unsigned* w, unsigned* h,
+                             LodePNGState* state,
+                             const unsigned char* in, size_t insize);
+
 /*
 Read the PNG header, but not the actual data. This returns only the information
 that is in the header chunk of the PNG, such as width, height and color type. The
@@ -663,6 +685,29 @@ information is placed in the info_png field of the LodePNGState.
 unsigned lodepng_inspect(unsigned* w, unsigned* h,
                          LodePNGState* state,
                          const unsigned char* in, size_t insize);
+
+/*
+Receives consecutive bands of decoded scanlines from lodepng_decode_bands.
+band: rows [y, y + rows) of the image, packed the same way as lodepng_decode output.
+The memory is owned by the decoder and only valid during the call.
+Return 0 to continue decoding, or any other value to stop; lodepng_decode_bands
+then returns that value as its error code.
+*/
+typedef unsigned (*LodePNGBandCallback)(const unsigned char* band, unsigned y, unsigned rows, void* context);
+
+/*
+Decodes the image band_height scanlines at a time, without ever holding the full
+image or the full decompressed IDAT data in memory. Each band is passed to the
+callback as soon as it is unfiltered, the last band may have less rows.
+The output is always in the PNG's own color type, as if decoder.color_convert was
+disabled, and info_raw is set to it. *w and *h are set before the first callback.
+Interlaced images are not supported, and custom_zlib and custom_inflate of the
+decompress settings are not used.
+*/
+unsigned lodepng_decode_bands(unsigned* w, unsigned* h,
+                              LodePNGState* state,
+                              const unsigned char* in, size_t insize,
+                              unsigned band_height, LodePNGBandCallback callback, void* context);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 
@@ -791,6 +836,24 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings);
 
+/*
+Compress in[start, end) as one piece of the deflate stream of in[0, insize), so that
+the pieces of a stream can be compressed independently, for example on several
+threads. Matches may refer back to the data before start, up to the window size.
+Unless end is insize, the last block of the piece is not final, and an empty stored
+block follows it, so that the pieces concatenated in order form one valid stream.
+Out buffer must be freed after use.
+*/
+unsigned lodepng_deflate_range(unsigned char** out, size_t* outsize,
+                               const unsigned char* in, size_t insize, size_t start, size_t end,
+                               const LodePNGCompressSettings* settings);
+
+/*Adler-32 checksum of the data that follows the data with checksum adler (1 for none).*/
+unsigned lodepng_update_adler32(unsigned adler, const unsigned char* data, size_t len);
+
+/*Adler-32 checksum of two consecutive ranges, from their checksums and the length of the second.*/
+unsigned lodepng_adler32_combine(unsigned adler1, unsigned adler2, size_t len2);
+
 #endif /*LODEPNG_COMPILE_ENCODER*/
 #endif /*LODEPNG_COMPILE_ZLIB*/
 
@@ -838,6 +901,10 @@ unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
 unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
                 State& state,
                 const std::vector<unsigned char>& in);
+/* Decodes into the caller-owned buffer out, see lodepng_decode_into. */
+unsigned decode(unsigned char* out, size_t outsize, unsigned& w, unsigned& h,
+                State& state,
+                const unsigned char* in, size_t insize);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -0,0 +1,104 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef PICTOLEV_LODEPNG_ARENA_H
+#define PICTOLEV_LODEPNG_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Allocator for lodepng's internal buffers. lodepng.cpp is built with
+// LODEPNG_NO_COMPILE_ALLOCATORS, and its lodepng_malloc, lodepng_realloc and
+// lodepng_free hooks serve the calling thread from the arena set with
+// lodepng_arena_scope, or from the heap when there is none.
+// Small allocations are carved out of large chunks in power of two sizes, and
+// freed ones are reused for allocations of the same size class. Large ones get
+// their own block, which is kept for reuse when freed, up to a limit.
+class lodepng_arena {
+public:
+	static constexpr std::size_t default_chunk_size = 1 << 18;
+	static constexpr std::size_t default_spare_limit = 1 << 22;
+	explicit lodepng_arena(std::size_t chunk_size = default_chunk_size, std::size_t spare_limit = default_spare_limit);
+	lodepng_arena(const lodepng_arena&) = delete;
+	lodepng_arena& operator=(const lodepng_arena&) = delete;
+	~lodepng_arena();
+	// Makes all memory allocated from the arena available again. Nothing that
+	// was allocated from it may be used afterwards, including buffers owned by
+	// a lodepng::State.
+	void reset() noexcept;
+	void* allocate(std::size_t size) noexcept;
+	void* reallocate(void* pointer, std::size_t size) noexcept;
+	void release(void* pointer) noexcept;
+private:
+	struct chunk {
+		std::unique_ptr<unsigned char[]> data;
+		std::size_t size;
+	};
+	void* allocate_large(std::size_t size) noexcept;
+	void* allocate_small(std::size_t size) noexcept;
+	std::size_t chunk_size;
+	std::size_t spare_limit;
+	std::vector<chunk> chunks;
+	std::size_t current_chunk = 0;
+	std::size_t current_offset = 0;
+	// The last small allocation, which can grow in place.
+	void* top = nullptr;
+	// Freed small blocks of each size class, linked through their first bytes.
+	std::vector<void*> free_lists;
+	// Freed large blocks, kept for reuse.
+	std::vector<void*> spares;
+	std::size_t spare_size = 0;
+};
+
+// Routes the lodepng allocations of the current thread to the arena for the
+// lifetime of the object.
+class lodepng_arena_scope {
+public:
+	explicit lodepng_arena_scope(lodepng_arena& arena) noexcept;
+	lodepng_arena_scope(const lodepng_arena_scope&) = delete;
+	lodepng_arena_scope& operator=(const lodepng_arena_scope&) = delete;
+	~lodepng_arena_scope();
+private:
+	lodepng_arena* previous;
+};
+
+// Counts of the allocation requests made by lodepng since the program started.
+struct lodepng_allocation_stats {
+	// Requests served with malloc or realloc, including new arena chunks.
+	std::size_t heap_allocations;
+	// Requests served from arena chunks or reused blocks.
+	std::size_t arena_allocations;
+	// Calls to lodepng_free with a non-null pointer.
+	std::size_t frees;
+};
+
+lodepng_allocation_stats get_lodepng_allocation_stats() noexcept;
+
+// The allocation hooks of lodepng.cpp, for buffers handed to or received from lodepng.
+void* lodepng_malloc(std::size_t size);
+void* lodepng_realloc(void* pointer, std::size_t new_size);
+void lodepng_free(void* pointer);
+
+#endif
@@ -0,0 +1,62 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef PICTOLEV_MAPPED_FILE_H
+#define PICTOLEV_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <gsl/gsl_util>
+#include <gsl/span>
+
+// Read-only view of a whole file. Regular files are memory-mapped and hinted
+// for sequential access; pipes and other non-regular files are read into an
+// owned buffer instead.
+class mapped_file {
+public:
+	mapped_file() noexcept = default;
+	mapped_file(const mapped_file&) = delete;
+	mapped_file(mapped_file&& other) noexcept;
+	mapped_file& operator=(const mapped_file&) = delete;
+	mapped_file& operator=(mapped_file&& other) noexcept;
+	~mapped_file();
+	std::error_code open(const std::string& filename);
+	void close() noexcept;
+	gsl::span<const unsigned char> data() const noexcept {
+		return {view, gsl::narrow_cast<gsl::span<const unsigned char>::index_type>(view_size)};
+	}
+	bool is_mapped() const noexcept {
+		return mapped;
+	}
+private:
+	std::error_code map(const std::string& filename);
+	const unsigned char* view = nullptr;
+	std::size_t view_size = 0;
+	bool mapped = false;
+	std::vector<unsigned char> fallback;
+};
+
+#endif
@@ -0,0 +1,49 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef PICTOLEV_PARALLEL_DEFLATE_H
+#define PICTOLEV_PARALLEL_DEFLATE_H
+
+#include <cstddef>
+#include <lodepng.h>
+
+// Settings of parallel_zlib_compress, passed through
+// LodePNGCompressSettings::custom_context.
+struct parallel_deflate_options {
+	static constexpr std::size_t default_min_piece_size = 1 << 18;
+	// How many pieces are deflated at once; the pieces do not depend on it.
+	unsigned thread_count;
+	// Inputs are split into as many pieces of at least this size as they hold.
+	std::size_t min_piece_size = default_min_piece_size;
+};
+
+// Compresses in to a zlib stream, for LodePNGCompressSettings::custom_zlib.
+// The input is split into pieces that are deflated on up to thread_count threads
+// with lodepng_deflate_range, each one using the data before it as its dictionary.
+// The pieces end with sync flushes and are concatenated, and the Adler-32
+// checksums computed along with them are combined into that of the whole input.
+unsigned parallel_zlib_compress(unsigned char** out, std::size_t* outsize, const unsigned char* in, std::size_t insize,
+	const LodePNGCompressSettings* settings);
+
+#endif
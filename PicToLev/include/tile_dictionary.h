@@ -0,0 +1,181 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef PICTOLEV_TILE_DICTIONARY_H
+#define PICTOLEV_TILE_DICTIONARY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Thrown by tile_dictionary when a distinct tile would need an ID past max_size.
+class tile_dictionary_full : public std::length_error {
+public:
+	tile_dictionary_full() : std::length_error("tile_dictionary: too many distinct tiles") {}
+};
+
+struct tile_dictionary_stats {
+	std::size_t size;
+	std::size_t capacity;
+	std::size_t lookups;
+	// Slots inspected over all lookups, including the one that ended each lookup.
+	std::size_t probes;
+	std::size_t max_probe_length;
+	// Full tile comparisons, each one caused by a matching fingerprint.
+	std::size_t comparisons;
+};
+
+// Assigns consecutive 16-bit IDs to distinct tiles. The hash table uses open
+// addressing with linear probing and keeps the 64-bit fingerprints and the IDs
+// in separate arrays. The tiles themselves are kept in an array indexed by ID,
+// and a tile is compared in full only when its fingerprint matches.
+template<class Tile, class Hash, class KeyEqual = std::equal_to<>>
+class tile_dictionary {
+public:
+	using id_type = std::uint16_t;
+	static constexpr std::size_t max_size = std::numeric_limits<id_type>::max();
+	// Sized so that expected_size distinct tiles stay under the maximum load factor.
+	explicit tile_dictionary(std::size_t expected_size, Hash hash = Hash(), KeyEqual equal = KeyEqual()) :
+		hash(std::move(hash)), equal(std::move(equal))
+	{
+		rehash(capacity_for(std::min(expected_size, max_size)));
+		tiles.reserve(std::min(expected_size, max_size));
+	}
+	// Returns the ID of the tile equal to the given one and false, or, if there
+	// is none, adds store(tile, id) under the next ID and returns that ID and true.
+	// Throws tile_dictionary_full if all max_size IDs are taken.
+	// store must return a tile equal to its argument that outlives the dictionary.
+	template<class Store>
+	std::pair<id_type, bool> emplace(const Tile& tile, Store&& store) {
+		return emplace(tile, hash(tile), std::forward<Store>(store));
+	}
+	// Same as above, with the fingerprint already computed by hash_function.
+	template<class Store>
+	std::pair<id_type, bool> emplace(const Tile& tile, std::uint64_t fingerprint, Store&& store) {
+		std::size_t slot = home_slot(fingerprint);
+		std::size_t probe_length = 1;
+		for (; ids[slot] != empty_id; slot = (slot + 1) & slot_mask, probe_length++) {
+			if (fingerprints[slot] != fingerprint)
+				continue;
+			comparisons++;
+			if (equal(tiles[ids[slot]], tile)) {
+				record_lookup(probe_length);
+				return {ids[slot], false};
+			}
+		}
+		record_lookup(probe_length);
+		if (tiles.size() == max_size)
+			throw tile_dictionary_full();
+		const id_type id = static_cast<id_type>(tiles.size());
+		tiles.push_back(store(tile, id));
+		if (tiles.size() > max_load(ids.size())) {
+			rehash(ids.size() * 2);
+			insert_slot(fingerprint, id);
+		} else {
+			fingerprints[slot] = fingerprint;
+			ids[slot] = id;
+		}
+		return {id, true};
+	}
+	const Hash& hash_function() const noexcept {
+		return hash;
+	}
+	std::size_t size() const noexcept {
+		return tiles.size();
+	}
+	// The stored tiles, indexed by ID.
+	const std::vector<Tile>& values() const noexcept {
+		return tiles;
+	}
+	double load_factor() const noexcept {
+		return static_cast<double>(tiles.size()) / ids.size();
+	}
+	tile_dictionary_stats stats() const noexcept {
+		return {tiles.size(), ids.size(), lookups, probes, max_probe_length, comparisons};
+	}
+private:
+	static constexpr id_type empty_id = std::numeric_limits<id_type>::max();
+	// Load factor at most 1/2: linear probing stays short and the table small.
+	static constexpr std::size_t max_load(std::size_t capacity) noexcept {
+		return capacity / 2;
+	}
+	static std::size_t capacity_for(std::size_t size) noexcept {
+		std::size_t capacity = 16;
+		while (max_load(capacity) < size) {
+			capacity *= 2;
+		}
+		return capacity;
+	}
+	// Fibonacci hashing spreads the fingerprint's high-entropy bits over the slot index.
+	std::size_t home_slot(std::uint64_t fingerprint) const noexcept {
+		return static_cast<std::size_t>((fingerprint * 0x9E3779B97F4A7C15u) >> slot_shift);
+	}
+	void insert_slot(std::uint64_t fingerprint, id_type id) noexcept {
+		std::size_t slot = home_slot(fingerprint);
+		while (ids[slot] != empty_id) {
+			slot = (slot + 1) & slot_mask;
+		}
+		fingerprints[slot] = fingerprint;
+		ids[slot] = id;
+	}
+	void rehash(std::size_t capacity) {
+		std::vector<std::uint64_t> old_fingerprints(capacity);
+		std::vector<id_type> old_ids(capacity, empty_id);
+		old_fingerprints.swap(fingerprints);
+		old_ids.swap(ids);
+		slot_mask = capacity - 1;
+		slot_shift = 64;
+		for (std::size_t bits = capacity; bits > 1; bits >>= 1) {
+			slot_shift--;
+		}
+		for (std::size_t slot = 0; slot != old_ids.size(); slot++) {
+			if (old_ids[slot] != empty_id) {
+				insert_slot(old_fingerprints[slot], old_ids[slot]);
+			}
+		}
+	}
+	void record_lookup(std::size_t probe_length) noexcept {
+		lookups++;
+		probes += probe_length;
+		max_probe_length = std::max(max_probe_length, probe_length);
+	}
+	Hash hash;
+	KeyEqual equal;
+	std::vector<std::uint64_t> fingerprints;
+	std::vector<id_type> ids;
+	std::vector<Tile> tiles;
+	std::size_t slot_mask = 0;
+	unsigned slot_shift = 64;
+	std::size_t lookups = 0;
+	std::size_t probes = 0;
+	std::size_t max_probe_length = 0;
+	std::size_t comparisons = 0;
+};
+
+#endif
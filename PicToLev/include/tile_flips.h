@@ -0,0 +1,164 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef PICTOLEV_TILE_FLIPS_H
+#define PICTOLEV_TILE_FLIPS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <gsl/gsl_util>
+#include "container_hash.h"
+#include "tiles.h"
+#include "word_hash.h"
+
+// Mirror images of a tile, as sets of bits. Flips commute and undo themselves,
+// so the flip between two mirror images is the exclusive or of theirs.
+enum tile_flip : unsigned {
+	no_flip = 0,
+	horizontal_flip = 1,
+	vertical_flip = 2,
+};
+
+constexpr unsigned tile_flip_count = 4;
+
+// Row y of the tile mirrored vertically by flip; the horizontal part is left to the caller.
+template<class T, std::size_t Size>
+typename tile_view<T, Size>::value_type flipped_row(const tile_view<T, Size>& tile, gsl::index y, unsigned flip) {
+	return tile[flip & vertical_flip ? gsl::narrow_cast<gsl::index>(Size) - 1 - y : y];
+}
+
+// Compares the tile mirrored by lhs_flip with the same tile mirrored by
+// rhs_flip in row-major order, returning a negative, zero or positive value
+// like std::memcmp.
+template<class T, std::size_t Size>
+int compare_flips(const tile_view<T, Size>& tile, unsigned lhs_flip, unsigned rhs_flip) {
+	const auto compare_rows = [](auto lhs_first, auto rhs_first) {
+		const auto [lhs, rhs] = std::mismatch(lhs_first, lhs_first + Size, rhs_first);
+		return lhs == lhs_first + Size ? 0 : *lhs < *rhs ? -1 : 1;
+	};
+	// Reversed rows are read backwards from one past their ends.
+	const auto reversed = [](const T* row) { return std::make_reverse_iterator(row + Size); };
+	for (gsl::index y = 0; y != gsl::narrow_cast<gsl::index>(Size); y++) {
+		const T* lhs_row = flipped_row(tile, y, lhs_flip).data();
+		const T* rhs_row = flipped_row(tile, y, rhs_flip).data();
+		int order;
+		if (lhs_flip & horizontal_flip)
+			order = rhs_flip & horizontal_flip ? compare_rows(reversed(lhs_row), reversed(rhs_row)) : compare_rows(reversed(lhs_row), rhs_row);
+		else
+			order = rhs_flip & horizontal_flip ? compare_rows(lhs_row, reversed(rhs_row)) : compare_rows(lhs_row, rhs_row);
+		if (order != 0)
+			return order;
+	}
+	return 0;
+}
+
+// Whether lhs equals rhs mirrored by flip.
+template<class T, class U, std::size_t Size>
+bool equal_flipped(const tile_view<T, Size>& lhs, const tile_view<U, Size>& rhs, unsigned flip) {
+	if (flip == no_flip)
+		return lhs == rhs;
+	for (gsl::index y = 0; y != gsl::narrow_cast<gsl::index>(Size); y++) {
+		const T* lhs_row = lhs[y].data();
+		const U* rhs_row = flipped_row(rhs, y, flip).data();
+		const bool equal = flip & horizontal_flip ?
+			std::equal(lhs_row, lhs_row + Size, std::make_reverse_iterator(rhs_row + Size)) :
+			std::equal(lhs_row, lhs_row + Size, rhs_row);
+		if (!equal)
+			return false;
+	}
+	return true;
+}
+
+// Feeds the rows of the tile mirrored by flip to the hasher, the same way
+// container_word_hash feeds the rows of an unflipped tile.
+template<class T, std::size_t Size>
+void hash_flipped(word_hasher& hasher, const tile_view<T, Size>& tile, unsigned flip) noexcept {
+	static_assert(std::has_unique_object_representations_v<std::remove_cv_t<T>>, "Hashed elements must have unique object representations");
+	std::remove_cv_t<T> reversed[Size];
+	for (gsl::index y = 0; y != gsl::narrow_cast<gsl::index>(Size); y++) {
+		const T* data = flipped_row(tile, y, flip).data();
+		if (flip & horizontal_flip) {
+			std::reverse_copy(data, data + Size, std::begin(reversed));
+			data = reversed;
+		}
+		hasher.update(reinterpret_cast<const unsigned char*>(data), sizeof(reversed));
+	}
+}
+
+// A tile made of several planes of the same size, standing for its mirror image
+// by flip. Keys are equal when their mirror images are, so equal keys may hold
+// tiles that are mirror images of each other.
+template<class Tile>
+struct oriented_tile {
+	Tile tile;
+	unsigned flip = no_flip;
+};
+
+// The flip that turns the tile into its smallest mirror image, comparing the
+// planes one after another. Symmetric tiles get the smallest such flip, so a
+// tile that is its own smallest mirror image always gets no_flip.
+template<class Tile>
+unsigned canonical_flip(const Tile& tile) {
+	unsigned best = no_flip;
+	for (unsigned flip = no_flip + 1; flip != tile_flip_count; flip++) {
+		for (const auto& plane : tile) {
+			const int order = compare_flips(plane, flip, best);
+			if (order < 0)
+				best = flip;
+			if (order != 0)
+				break;
+		}
+	}
+	return best;
+}
+
+// Hashes the mirror image a key stands for, so that equal keys hash equally.
+// Unflipped keys hash exactly like their tiles under container_word_hash.
+struct oriented_tile_hash {
+	template<class Tile>
+	std::uint64_t operator()(const oriented_tile<Tile>& key) const noexcept {
+		if (key.flip == no_flip)
+			return container_word_hash()(key.tile);
+		word_hasher hasher;
+		for (const auto& plane : key.tile) {
+			hash_flipped(hasher, plane, key.flip);
+		}
+		return hasher.digest();
+	}
+};
+
+struct oriented_tile_equal {
+	template<class Tile>
+	bool operator()(const oriented_tile<Tile>& lhs, const oriented_tile<Tile>& rhs) const {
+		const unsigned flip = lhs.flip ^ rhs.flip;
+		return std::equal(std::begin(lhs.tile), std::end(lhs.tile), std::begin(rhs.tile), [flip](const auto& lhs_plane, const auto& rhs_plane) {
+			return equal_flipped(lhs_plane, rhs_plane, flip);
+		});
+	}
+};
+
+#endif
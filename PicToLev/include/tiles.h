@@ -34,47 +34,170 @@
 #include <gsl/gsl_util>
 #include <gsl/span>
 #include "grid_size.h"
+#include "uniform_rows.h"
 
-template<class T>
-using image_fragment = std::vector<gsl::span<T>>;
+// A square tile of Size by Size elements inside a larger image, addressed by the
+// pointer to its first element and the distance between consecutive rows.
+template<class T, std::size_t Size>
+class tile_view {
+public:
+	using element_type = T;
+	using value_type = gsl::span<T, static_cast<std::ptrdiff_t>(Size)>;
+	using size_type = std::size_t;
 
-template<class T>
-auto buffer_to_image(gsl::span<T> buffer, grid_size size) {
+	class iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = tile_view::value_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = value_type;
+
+		constexpr iterator() noexcept = default;
+		constexpr iterator(const tile_view& view, gsl::index y) noexcept : view(&view), y(y) {}
+		constexpr reference operator*() const {
+			return (*view)[y];
+		}
+		constexpr iterator& operator++() noexcept {
+			++y;
+			return *this;
+		}
+		constexpr iterator operator++(int) noexcept {
+			iterator result = *this;
+			++*this;
+			return result;
+		}
+		constexpr bool operator==(const iterator& other) const noexcept {
+			return view == other.view && y == other.y;
+		}
+		constexpr bool operator!=(const iterator& other) const noexcept {
+			return !(*this == other);
+		}
+
+	private:
+		const tile_view* view = nullptr;
+		gsl::index y = 0;
+	};
+
+	constexpr tile_view() noexcept = default;
+	// A stride of zero repeats the first row, which is enough to describe uniform tiles.
+	constexpr tile_view(T* data, std::ptrdiff_t stride) noexcept : first(data), row_stride(stride) {}
+
+	static constexpr size_type size() noexcept {
+		return Size;
+	}
+	constexpr T* data() const noexcept {
+		return first;
+	}
+	constexpr std::ptrdiff_t stride() const noexcept {
+		return row_stride;
+	}
+	constexpr value_type operator[](gsl::index y) const {
+		Expects(y >= 0 && y < gsl::narrow_cast<gsl::index>(Size));
+		return value_type(first + y * row_stride, static_cast<std::ptrdiff_t>(Size));
+	}
+	constexpr iterator begin() const noexcept {
+		return iterator(*this, 0);
+	}
+	constexpr iterator end() const noexcept {
+		return iterator(*this, gsl::narrow_cast<gsl::index>(Size));
+	}
+
+private:
+	T* first = nullptr;
+	std::ptrdiff_t row_stride = 0;
+};
+
+template<class T, class U, std::size_t Size>
+bool operator==(const tile_view<T, Size>& lhs, const tile_view<U, Size>& rhs) {
+	for (gsl::index y = 0; y != gsl::narrow_cast<gsl::index>(Size); y++) {
+		const auto lhs_row = lhs[y];
+		const auto rhs_row = rhs[y];
+		if (!std::equal(lhs_row.begin(), lhs_row.end(), rhs_row.begin()))
+			return false;
+	}
+	return true;
+}
+
+template<class T, class U, std::size_t Size>
+bool operator!=(const tile_view<T, Size>& lhs, const tile_view<U, Size>& rhs) {
+	return !(lhs == rhs);
+}
+
+// Whether all elements of the tile are equal to its first one, which is stored
+// in value. Byte tiles are checked by uniform_rows; other rows are compared
+// without early exits, so that the comparison of a whole row can be vectorized.
+template<class T, std::size_t Size>
+bool is_uniform(const tile_view<T, Size>& tile, std::remove_cv_t<T>& value) {
+	static_assert(std::is_integral_v<std::remove_cv_t<T>>, "Uniform tiles are only detected for integral elements");
+	value = *tile.data();
+	if constexpr (std::is_same_v<std::remove_cv_t<T>, unsigned char>) {
+		return uniform_rows(tile.data(), tile.stride(), Size, Size, value);
+	}
+	for (gsl::index y = 0; y != gsl::narrow_cast<gsl::index>(Size); y++) {
+		const T* row = tile[y].data();
+		std::remove_cv_t<T> differences = 0;
+		for (std::size_t x = 0; x != Size; x++) {
+			differences |= row[x] ^ value;
+		}
+		if (differences != 0)
+			return false;
+	}
+	return true;
+}
+
+template<class T, std::size_t TileSize>
+using tile_vector = std::vector<tile_view<T, TileSize>>;
+
+// Splits a row-major image into views of its tiles, in row-major tile order.
+template<std::size_t TileSize, class T>
+tile_vector<T, TileSize> buffer_to_tile_list(gsl::span<T> buffer, grid_size size) {
 	Expects(gsl::narrow_cast<std::size_t>(buffer.size()) == grid_area(size));
-	image_fragment<T> image(size.height);
-	std::generate(image.begin(), image.end(), [buffer, width = size.width]() mutable {
-		gsl::span<T> row = buffer.subspan(0, width);
-		buffer = buffer.subspan(width);
-		return row;
-	});
-	return image;
+	Expects(size.width % TileSize == 0 && size.height % TileSize == 0);
+	const std::ptrdiff_t stride = gsl::narrow_cast<std::ptrdiff_t>(size.width);
+	tile_vector<T, TileSize> tiles;
+	tiles.reserve(grid_area({size.width / TileSize, size.height / TileSize}));
+	for (std::size_t y = 0; y != size.height; y += TileSize) {
+		for (std::size_t x = 0; x != size.width; x += TileSize) {
+			tiles.emplace_back(buffer.data() + y * size.width + x, stride);
+		}
+	}
+	return tiles;
 }
 
-template<class T>
-using tile_vector = std::vector<image_fragment<T>>;
-
-template<class ForwardIt>
-auto image_to_tile_list(ForwardIt first, ForwardIt last, std::size_t tile_size) {
-	Expects(std::distance(first, last) % tile_size == 0);
-	Expects(first == last || first->size() % tile_size == 0);
-	using container_type = std::remove_reference_t<typename ForwardIt::reference>;
-	using value_type = std::remove_reference_t<typename container_type::reference>;
-	const grid_size size {
-		first != last ? first->size() / tile_size : 0,
-		std::distance(first, last) / tile_size,
-	};
-	tile_vector<value_type> tiles(grid_area(size), image_fragment<value_type>(tile_size));
-	auto out = tiles.begin();
-	while (first != last) {
-		ForwardIt second = first;
-		std::advance(second, tile_size);
-		for (gsl::index x = 0; x != first->size(); x += tile_size) {
-			std::transform(first, second, out->begin(), [=](const auto& row) {
-				return gsl::span<value_type>(row).subspan(x, tile_size);
-			});
-			++out;
+// Rearranges a row-major image into tile-major order: every tile becomes a
+// contiguous block of TileSize * TileSize elements, in row-major tile order.
+// The source is read once, front to back.
+template<std::size_t TileSize, class T>
+void repack_tiles(gsl::span<const T> buffer, grid_size size, gsl::span<T> out) {
+	Expects(gsl::narrow_cast<std::size_t>(buffer.size()) == grid_area(size));
+	Expects(out.size() == buffer.size());
+	Expects(size.width % TileSize == 0 && size.height % TileSize == 0);
+	constexpr std::size_t block_size = TileSize * TileSize;
+	const T* in = buffer.data();
+	T* band = out.data();
+	for (std::size_t y = 0; y != size.height; y += TileSize) {
+		for (std::size_t row = 0; row != TileSize; row++) {
+			T* block_row = band + row * TileSize;
+			for (std::size_t x = 0; x != size.width; x += TileSize) {
+				std::copy(in, in + TileSize, block_row);
+				in += TileSize;
+				block_row += block_size;
+			}
 		}
-		first = second;
+		band += TileSize * size.width;
+	}
+}
+
+// Views of the tiles of a buffer filled by repack_tiles.
+template<std::size_t TileSize, class T>
+tile_vector<T, TileSize> packed_buffer_to_tile_list(gsl::span<T> buffer) {
+	constexpr std::size_t block_size = TileSize * TileSize;
+	Expects(gsl::narrow_cast<std::size_t>(buffer.size()) % block_size == 0);
+	tile_vector<T, TileSize> tiles;
+	tiles.reserve(gsl::narrow_cast<std::size_t>(buffer.size()) / block_size);
+	for (std::size_t offset = 0; offset != gsl::narrow_cast<std::size_t>(buffer.size()); offset += block_size) {
+		tiles.emplace_back(buffer.data() + offset, gsl::narrow_cast<std::ptrdiff_t>(TileSize));
 	}
 	return tiles;
 }
@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef PICTOLEV_WORD_HASH_H
+#define PICTOLEV_WORD_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Incremental 64-bit hash of a byte stream, following the XXH64 algorithm. The
+// input is consumed as 64-bit words in stripes of four independent lanes, and
+// the result only depends on the concatenated bytes, not on how they were split
+// between calls to update.
+class word_hasher {
+public:
+	static constexpr std::size_t stripe_size = 32;
+	explicit word_hasher(std::uint64_t seed = 0) noexcept :
+		lanes {seed + prime1 + prime2, seed + prime2, seed, seed - prime1}, seed(seed) {}
+	void update(const unsigned char* data, std::size_t size) noexcept {
+		total_size += size;
+		if (pending_size != 0) {
+			const std::size_t count = size < stripe_size - pending_size ? size : stripe_size - pending_size;
+			std::memcpy(pending + pending_size, data, count);
+			pending_size += count;
+			data += count;
+			size -= count;
+			if (pending_size != stripe_size)
+				return;
+			consume_stripe(pending);
+			pending_size = 0;
+		}
+		for (; size >= stripe_size; data += stripe_size, size -= stripe_size) {
+			consume_stripe(data);
+		}
+		std::memcpy(pending, data, size);
+		pending_size = size;
+	}
+	std::uint64_t digest() const noexcept {
+		std::uint64_t hash;
+		if (total_size >= stripe_size) {
+			hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+			for (const std::uint64_t lane : lanes) {
+				hash = (hash ^ round(0, lane)) * prime1 + prime4;
+			}
+		} else {
+			hash = seed + prime5;
+		}
+		hash += total_size;
+		const unsigned char* tail = pending;
+		std::size_t size = pending_size;
+		for (; size >= 8; tail += 8, size -= 8) {
+			hash = rotate_left(hash ^ round(0, read64(tail)), 27) * prime1 + prime4;
+		}
+		if (size >= 4) {
+			hash = rotate_left(hash ^ read32(tail) * prime1, 23) * prime2 + prime3;
+			tail += 4;
+			size -= 4;
+		}
+		for (; size != 0; tail++, size--) {
+			hash = rotate_left(hash ^ *tail * prime5, 11) * prime1;
+		}
+		hash ^= hash >> 33;
+		hash *= prime2;
+		hash ^= hash >> 29;
+		hash *= prime3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+private:
+	static constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87u;
+	static constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4Fu;
+	static constexpr std::uint64_t prime3 = 0x165667B19E3779F9u;
+	static constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63u;
+	static constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5u;
+	static constexpr std::uint64_t rotate_left(std::uint64_t value, unsigned count) noexcept {
+		return value << count | value >> (64 - count);
+	}
+	static constexpr std::uint64_t round(std::uint64_t lane, std::uint64_t input) noexcept {
+		return rotate_left(lane + input * prime2, 31) * prime1;
+	}
+	// Words are read as little-endian, so the hash does not depend on the platform.
+	static std::uint64_t read64(const unsigned char* data) noexcept {
+		std::uint64_t value = 0;
+		for (unsigned i = 0; i != 8; i++) {
+			value |= std::uint64_t(data[i]) << (i * 8);
+		}
+		return value;
+	}
+	static std::uint64_t read32(const unsigned char* data) noexcept {
+		std::uint64_t value = 0;
+		for (unsigned i = 0; i != 4; i++) {
+			value |= std::uint64_t(data[i]) << (i * 8);
+		}
+		return value;
+	}
+	void consume_stripe(const unsigned char* data) noexcept {
+		lanes[0] = round(lanes[0], read64(data));
+		lanes[1] = round(lanes[1], read64(data + 8));
+		lanes[2] = round(lanes[2], read64(data + 16));
+		lanes[3] = round(lanes[3], read64(data + 24));
+	}
+	std::uint64_t lanes[4];
+	std::uint64_t seed;
+	std::uint64_t total_size = 0;
+	unsigned char pending[stripe_size];
+	std::size_t pending_size = 0;
+};
+
+#endif
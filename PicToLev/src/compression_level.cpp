@@ -0,0 +1,82 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#include "compression_level.h"
+#include <vector>
+#include <lodepng.h>
+
+// The tilesets are 8-bit palette images, which stay unfiltered at every level as
+// filter_palette_zero is kept, so the filter strategy is never consulted.
+// Filtering them made the output larger.
+void set_compression_level(LodePNGEncoderSettings& encoder, compression_level level) {
+	LodePNGCompressSettings& zlib = encoder.zlibsettings;
+	switch (level) {
+	case compression_level::store:
+		// Stored blocks only: the data is copied without compression.
+		zlib.btype = 0;
+		zlib.use_lz77 = false;
+		break;
+	case compression_level::fast:
+		zlib.btype = 2;
+		zlib.use_lz77 = true;
+		zlib.windowsize = 4096;
+		zlib.minmatch = 3;
+		zlib.nicematch = 32;
+		zlib.lazymatching = false;
+		zlib.maxchainlength = 4;
+		break;
+	case compression_level::normal:
+		// lodepng's defaults.
+		zlib.btype = 2;
+		zlib.use_lz77 = true;
+		zlib.windowsize = 2048;
+		zlib.minmatch = 3;
+		zlib.nicematch = 128;
+		zlib.lazymatching = true;
+		zlib.maxchainlength = 0;
+		break;
+	case compression_level::max:
+		// Tuned with encode_benchmark on the tilesets of make_level.py levels,
+		// drawn with --art and from noise: each one comes out smaller than at
+		// the default level. Matches of 3 bytes across the whole window cost
+		// more than their literals on the noise, and longer minimums lose the
+		// short matches that drawn tiles are full of.
+		zlib.btype = 2;
+		zlib.use_lz77 = true;
+		zlib.windowsize = 32768;
+		zlib.minmatch = 4;
+		zlib.nicematch = 258;
+		zlib.lazymatching = true;
+		zlib.maxchainlength = 4096;
+		break;
+	}
+	encoder.filter_palette_zero = true;
+}
+
+unsigned encode_at_level(std::vector<unsigned char>& out, const std::vector<unsigned char>& image, unsigned width, unsigned height,
+	lodepng::State& state, compression_level level) {
+	set_compression_level(state.encoder, level);
+	out.clear();
+	return lodepng::encode(out, image, width, height, state);
+}
@@ -34,6 +34,16 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef LODEPNG_COMPILE_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LODEPNG_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif /*_MSC_VER*/
+#endif
+#endif /*LODEPNG_COMPILE_SIMD*/
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -52,12 +62,10 @@ with the "LODEPNG_COMPILE_" #defines divide this up further in an intermixed way
 
 /*The malloc, realloc and free functions defined here with "lodepng_" in front
 of the name, so that you can easily change them to others related to your
-platform if needed. Everything else in the code calls these. Pass
--DLODEPNG_NO_COMPILE_ALLOCATORS to the compiler, or comment out
-#define LODEPNG_COMPILE_ALLOCATORS in the header, to disable the ones here and
-define them in your own project's source files without needing to change
-lodepng source code. Don't forget to remove "static" if you copypaste them
-from here.*/
+platform if needed. Everything else in the code calls these. In PicToLev,
+lodepng.h always defines LODEPNG_NO_COMPILE_ALLOCATORS, so the ones here are
+never compiled: lodepng_malloc, lodepng_realloc and lodepng_free are always
+provided by src/lodepng_arena.cpp, which serves them from arenas.*/
 
 #ifdef LODEPNG_COMPILE_ALLOCATORS
 static void* lodepng_malloc(size_t size)
@@ -123,6 +131,65 @@ Example: if(!uivector_resizev(&frequencies_ll, 286, 0)) ERROR_BREAK(83);
   return;\
 }
 
+/*
+Instruction sets the CPU running this code supports, as a combination of the
+LODEPNG_CPU_ flags. SSE2 is reported when the compiler targets it, the others
+are detected at runtime. Code using them checks these flags, so that
+e.g. testing code can compare the paths by passing a subset.
+*/
+#define LODEPNG_CPU_SSE2 1u
+#define LODEPNG_CPU_AVX2 2u
+#define LODEPNG_CPU_PCLMUL 8u
+
+#if defined(LODEPNG_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+/*functions using instructions the compiler doesn't target by default, only called after checking the CPU*/
+#define LODEPNG_TARGET(isa) __attribute__((target(isa)))
+#else
+#define LODEPNG_TARGET(isa)
+#endif
+
+#if defined(LODEPNG_SIMD_X86) && defined(_MSC_VER)
+static unsigned detectCPUFeatures(void)
+{
+  unsigned features = LODEPNG_CPU_SSE2;
+  int info[4], maxleaf;
+  __cpuid(info, 0);
+  maxleaf = info[0];
+  if(maxleaf >= 1)
+  {
+    __cpuid(info, 1);
+    if(info[2] & (1 << 1)) features |= LODEPNG_CPU_PCLMUL;
+    /*the OS must also save the AVX registers on context switches, which it reports with OSXSAVE and XCR0*/
+    if(maxleaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6)
+    {
+      __cpuidex(info, 7, 0);
+      if(info[1] & (1 << 5)) features |= LODEPNG_CPU_AVX2;
+    }
+  }
+  return features;
+}
+
+static unsigned lodepng_cpu_features(void)
+{
+  /*initialization of a function-local static is thread-safe in C++11, so detection runs once*/
+  static const unsigned features = detectCPUFeatures();
+  return features;
+}
+#elif defined(LODEPNG_SIMD_X86)
+static unsigned lodepng_cpu_features(void)
+{
+  unsigned features = LODEPNG_CPU_SSE2;
+  if(__builtin_cpu_supports("avx2")) features |= LODEPNG_CPU_AVX2;
+  if(__builtin_cpu_supports("pclmul")) features |= LODEPNG_CPU_PCLMUL;
+  return features;
+}
+#else
+static unsigned lodepng_cpu_features(void)
+{
+  return 0;
+}
+#endif
+
 /*
 About uivector, ucvector and string:
 -All of them wrap dynamic arrays or text strings in a similar way.
@@ -442,23 +509,74 @@ static void addBitsToStreamReversed(size_t* bitpointer, ucvector* bitstream, uns
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-#define READBIT(bitpointer, bitstream) ((bitstream[bitpointer >> 3] >> (bitpointer & 0x7)) & (unsigned char)1)
-
-static unsigned char readBitFromStream(size_t* bitpointer, const unsigned char* bitstream)
-{
-  unsigned char result = (unsigned char)(READBIT(*bitpointer, bitstream));
-  ++(*bitpointer);
-  return result;
+/*
+Reads the bits of a deflate stream, from lsb to msb of each byte. The bits at the
+current position are kept in a 64-bit buffer, which refillBits loads with a whole
+word at once, so that a symbol and its extra bits can be taken from it with shifts.
+*/
+typedef struct BitReader
+{
+  const unsigned char* data;
+  size_t size; /*size of data in bytes*/
+  size_t bitsize; /*size of data in bits*/
+  size_t bp; /*current bit position, the bits before it are consumed*/
+  unsigned long long buffer; /*the bits starting at bp, the next bit is the lsb*/
+} BitReader;
+
+/*returns error if the size in bits doesn't fit in a size_t*/
+static unsigned BitReader_init(BitReader* reader, const unsigned char* data, size_t size)
+{
+  if(size > ((size_t)(-1)) / 8u) return 92; /*overflow*/
+  reader->data = data;
+  reader->size = size;
+  reader->bitsize = size * 8u;
+  reader->bp = 0;
+  reader->buffer = 0;
+  return 0;
 }
 
-static unsigned readBitsFromStream(size_t* bitpointer, const unsigned char* bitstream, size_t nbits)
+/*
+loads the buffer from the current position. Afterwards at least 57 bits can be read before
+refilling again, enough for a length and distance code with their extra bits (15 + 5 + 15 + 13).
+Bits past the end of the data read as 0, callers compare bp with bitsize to detect that.
+*/
+static void refillBits(BitReader* reader)
 {
-  unsigned result = 0, i;
-  for(i = 0; i != nbits; ++i)
+  size_t start = reader->bp >> 3u;
+  const unsigned char* p = reader->data + start;
+  unsigned long long result = 0;
+  if(start + 8u <= reader->size)
   {
-    result += ((unsigned)READBIT(*bitpointer, bitstream)) << i;
-    ++(*bitpointer);
+    result = (unsigned long long)p[0] | ((unsigned long long)p[1] << 8u)
+           | ((unsigned long long)p[2] << 16u) | ((unsigned long long)p[3] << 24u)
+           | ((unsigned long long)p[4] << 32u) | ((unsigned long long)p[5] << 40u)
+           | ((unsigned long long)p[6] << 48u) | ((unsigned long long)p[7] << 56u);
   }
+  else
+  {
+    size_t i;
+    for(i = 0; start + i < reader->size; ++i) result |= (unsigned long long)p[i] << (8u * i);
+  }
+  reader->buffer = result >> (reader->bp & 7u);
+}
+
+/*the next nbits bits, without consuming them. nbits must be at most 31*/
+static unsigned peekBits(const BitReader* reader, unsigned nbits)
+{
+  return (unsigned)(reader->buffer & ((1ull << nbits) - 1u));
+}
+
+static void advanceBits(BitReader* reader, unsigned nbits)
+{
+  reader->buffer >>= nbits;
+  reader->bp += nbits;
+}
+
+/*reads nbits bits from the buffer, which must still hold that many since the last refillBits*/
+static unsigned readBits(BitReader* reader, unsigned nbits)
+{
+  unsigned result = peekBits(reader, nbits);
+  advanceBits(reader, nbits);
   return result;
 }
 #endif /*LODEPNG_COMPILE_DECODER*/
@@ -508,11 +626,13 @@ Huffman tree struct, containing multiple representations of the tree
 */
 typedef struct HuffmanTree
 {
-  unsigned* tree2d;
   unsigned* tree1d;
   unsigned* lengths; /*the lengths of the codes of the 1d-tree*/
   unsigned maxbitlen; /*maximum number of bits a single code can get*/
   unsigned numcodes; /*number of symbols in the alphabet = number of codes*/
+  /*lookup tables used by the decoder, indexed by the next bits of the stream, see HuffmanTree_makeTable*/
+  unsigned char* table_len; /*length of the code, or of the longest code in the subtable for long codes*/
+  unsigned short* table_value; /*the symbol, or the start of the subtable for long codes*/
 } HuffmanTree;
 
 /*function used for debug purposes to draw the tree in ascii art with C++*/
@@ -530,78 +650,154 @@ static void HuffmanTree_draw(HuffmanTree* tree)
 
 static void HuffmanTree_init(HuffmanTree* tree)
 {
-  tree->tree2d = 0;
   tree->tree1d = 0;
   tree->lengths = 0;
+  tree->table_len = 0;
+  tree->table_value = 0;
 }
 
 static void HuffmanTree_cleanup(HuffmanTree* tree)
 {
-  lodepng_free(tree->tree2d);
   lodepng_free(tree->tree1d);
   lodepng_free(tree->lengths);
+  lodepng_free(tree->table_len);
+  lodepng_free(tree->table_value);
 }
 
-/*the tree representation used by the decoder. return value is error*/
-static unsigned HuffmanTree_make2DTree(HuffmanTree* tree)
+#ifdef LODEPNG_COMPILE_DECODER
+/*amount of bits resolved by the first lookup table, codes longer than this continue in a subtable*/
+#define FIRSTBITS 9u
+/*table value of bit combinations that are not a valid code, larger than any symbol*/
+#define INVALIDSYMBOL 65535u
+/*table length of entries that aren't filled in yet, larger than any valid code length*/
+#define UNFILLEDLEN 16u
+
+static unsigned reverseBits(unsigned bits, unsigned num)
 {
-  unsigned nodefilled = 0; /*up to which node it is filled*/
-  unsigned treepos = 0; /*position in the tree (1 of the numcodes columns)*/
-  unsigned n, i;
+  unsigned i, result = 0;
+  for(i = 0; i != num; ++i) result |= ((bits >> (num - i - 1)) & 1u) << i;
+  return result;
+}
 
-  tree->tree2d = (unsigned*)lodepng_malloc(tree->numcodes * 2 * sizeof(unsigned));
-  if(!tree->tree2d) return 83; /*alloc fail*/
+/*
+the lookup tables used by the decoder. return value is error
+The first table has an entry for each combination of the next FIRSTBITS bits of
+the stream, taken in the order in which they are read (so Huffman codes, which are
+stored starting at their most significant bit, are reversed). For codes of at most
+FIRSTBITS bits, the entry is repeated for every value of the bits after the code,
+and holds the symbol and code length. For longer codes, the entry holds the length
+of the longest code sharing that prefix and the start of a subtable, which is
+indexed by the bits after the first FIRSTBITS the same way.
+*/
+static unsigned HuffmanTree_makeTable(HuffmanTree* tree)
+{
+  static const unsigned headsize = 1u << FIRSTBITS;
+  static const unsigned mask = (1u << FIRSTBITS) - 1u;
+  size_t i, size, pointer, numpresent;
+  unsigned* maxlens = (unsigned*)lodepng_malloc(headsize * sizeof(unsigned));
+  if(!maxlens) return 83; /*alloc fail*/
 
-  /*
-  convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means
-  uninited, a value >= numcodes is an address to another bit, a value < numcodes
-  is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as
-  many columns as codes - 1.
-  A good huffman tree has N * 2 - 1 nodes, of which N - 1 are internal nodes.
-  Here, the internal nodes are stored (what their 0 and 1 option point to).
-  There is only memory for such good tree currently, if there are more nodes
-  (due to too long length codes), error 55 will happen
-  */
-  for(n = 0; n < tree->numcodes * 2; ++n)
+  /*for each prefix of the first table, the longest code starting with it*/
+  for(i = 0; i != headsize; ++i) maxlens[i] = 0;
+  for(i = 0; i != tree->numcodes; ++i)
+  {
+    unsigned l = tree->lengths[i];
+    unsigned index;
+    if(l <= FIRSTBITS) continue;
+    index = reverseBits(tree->tree1d[i] >> (l - FIRSTBITS), FIRSTBITS);
+    if(maxlens[index] < l) maxlens[index] = l;
+  }
+  size = headsize;
+  for(i = 0; i != headsize; ++i)
+  {
+    if(maxlens[i] > FIRSTBITS) size += (size_t)1u << (maxlens[i] - FIRSTBITS);
+  }
+
+  tree->table_len = (unsigned char*)lodepng_malloc(size * sizeof(unsigned char));
+  tree->table_value = (unsigned short*)lodepng_malloc(size * sizeof(unsigned short));
+  if(!tree->table_len || !tree->table_value)
+  {
+    lodepng_free(maxlens);
+    return 83; /*alloc fail, the tables are freed by HuffmanTree_cleanup*/
+  }
+  for(i = 0; i != size; ++i) tree->table_len[i] = UNFILLEDLEN;
+
+  /*first table entries of long codes point to their subtable*/
+  pointer = headsize;
+  for(i = 0; i != headsize; ++i)
   {
-    tree->tree2d[n] = 32767; /*32767 here means the tree2d isn't filled there yet*/
+    unsigned l = maxlens[i];
+    if(l <= FIRSTBITS) continue;
+    tree->table_len[i] = (unsigned char)l;
+    tree->table_value[i] = (unsigned short)pointer;
+    pointer += (size_t)1u << (l - FIRSTBITS);
   }
+  lodepng_free(maxlens);
 
-  for(n = 0; n < tree->numcodes; ++n) /*the codes*/
+  numpresent = 0;
+  for(i = 0; i != tree->numcodes; ++i)
   {
-    for(i = 0; i != tree->lengths[n]; ++i) /*the bits for this code*/
+    unsigned l = tree->lengths[i];
+    unsigned reverse, j, num;
+    if(l == 0) continue;
+    reverse = reverseBits(tree->tree1d[i], l);
+    ++numpresent;
+    if(l <= FIRSTBITS)
     {
-      unsigned char bit = (unsigned char)((tree->tree1d[n] >> (tree->lengths[n] - i - 1)) & 1);
-      /*oversubscribed, see comment in lodepng_error_text*/
-      if(treepos > 2147483647 || treepos + 2 > tree->numcodes) return 55;
-      if(tree->tree2d[2 * treepos + bit] == 32767) /*not yet filled in*/
+      num = 1u << (FIRSTBITS - l);
+      for(j = 0; j != num; ++j)
       {
-        if(i + 1 == tree->lengths[n]) /*last bit*/
-        {
-          tree->tree2d[2 * treepos + bit] = n; /*put the current code in it*/
-          treepos = 0;
-        }
-        else
-        {
-          /*put address of the next step in here, first that address has to be found of course
-          (it's just nodefilled + 1)...*/
-          ++nodefilled;
-          /*addresses encoded with numcodes added to it*/
-          tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;
-          treepos = nodefilled;
-        }
+        unsigned index = reverse | (j << l);
+        /*oversubscribed, see comment in lodepng_error_text*/
+        if(tree->table_len[index] != UNFILLEDLEN) return 55;
+        tree->table_len[index] = (unsigned char)l;
+        tree->table_value[index] = (unsigned short)i;
+      }
+    }
+    else
+    {
+      unsigned index = reverse & mask;
+      unsigned maxlen = tree->table_len[index];
+      unsigned start = tree->table_value[index];
+      /*a long code shares its prefix with a short one: oversubscribed*/
+      if(maxlen < l || maxlen == UNFILLEDLEN) return 55;
+      num = 1u << (maxlen - l);
+      for(j = 0; j != num; ++j)
+      {
+        unsigned index2 = start + ((reverse >> FIRSTBITS) | (j << (l - FIRSTBITS)));
+        if(tree->table_len[index2] != UNFILLEDLEN) return 55;
+        tree->table_len[index2] = (unsigned char)l;
+        tree->table_value[index2] = (unsigned short)i;
       }
-      else treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
     }
   }
 
-  for(n = 0; n < tree->numcodes * 2; ++n)
+  if(numpresent < 2)
+  {
+    /*a tree with a single code, which deflate stores with 1 bit, or no codes at all (e.g. distances
+    of a block without back-references) leaves entries unfilled. Reading those must give an error,
+    so mark them invalid. The length is chosen so that the decoder stays in the right table.*/
+    for(i = 0; i != size; ++i)
+    {
+      if(tree->table_len[i] == UNFILLEDLEN)
+      {
+        tree->table_len[i] = (unsigned char)(i < headsize ? 1 : FIRSTBITS + 1);
+        tree->table_value[i] = INVALIDSYMBOL;
+      }
+    }
+  }
+  else
   {
-    if(tree->tree2d[n] == 32767) tree->tree2d[n] = 0; /*remove possible remaining 32767's*/
+    /*a complete tree fills every entry, otherwise some bit sequences can't be decoded*/
+    for(i = 0; i != size; ++i)
+    {
+      if(tree->table_len[i] == UNFILLEDLEN) return 55;
+    }
   }
 
   return 0;
 }
+#endif /*LODEPNG_COMPILE_DECODER*/
 
 /*
 Second step for the ...makeFromLengths and ...makeFromFrequencies functions.
@@ -644,8 +840,7 @@ static unsigned HuffmanTree_makeFromLengths2(HuffmanTree* tree)
   uivector_cleanup(&blcount);
   uivector_cleanup(&nextcode);
 
-  if(!error) return HuffmanTree_make2DTree(tree);
-  else return error;
+  return error;
 }
 
 /*
@@ -662,7 +857,12 @@ static unsigned HuffmanTree_makeFromLengths(HuffmanTree* tree, const unsigned* b
   for(i = 0; i != numcodes; ++i) tree->lengths[i] = bitlen[i];
   tree->numcodes = (unsigned)numcodes; /*number of symbols*/
   tree->maxbitlen = maxbitlen;
-  return HuffmanTree_makeFromLengths2(tree);
+  CERROR_TRY_RETURN(HuffmanTree_makeFromLengths2(tree));
+#ifdef LODEPNG_COMPILE_DECODER
+  return HuffmanTree_makeTable(tree);
+#else /*LODEPNG_COMPILE_DECODER*/
+  return 0;
+#endif /*LODEPNG_COMPILE_DECODER*/
 }
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -941,27 +1141,26 @@ static unsigned generateFixedDistanceTree(HuffmanTree* tree)
 #ifdef LODEPNG_COMPILE_DECODER
 
 /*
-returns the code, or (unsigned)(-1) if error happened
-inbitlength is the length of the complete buffer, in bits (so its byte length times 8)
+returns the code, or (unsigned)(-1) if the code ends past the end of the input,
+or INVALIDSYMBOL for bits that don't form a code. Takes up to 15 bits from the
+buffer of the reader, so those must be loaded with refillBits
 */
-static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
-                                    const HuffmanTree* codetree, size_t inbitlength)
+static unsigned huffmanDecodeSymbol(BitReader* reader, const HuffmanTree* codetree)
 {
-  unsigned treepos = 0, ct;
-  for(;;)
+  unsigned index = peekBits(reader, FIRSTBITS);
+  unsigned l = codetree->table_len[index];
+  unsigned value = codetree->table_value[index];
+  if(l > FIRSTBITS)
   {
-    if(*bp >= inbitlength) return (unsigned)(-1); /*error: end of input memory reached without endcode*/
-    /*
-    decode the symbol from the tree. The "readBitFromStream" code is inlined in
-    the expression below because this is the biggest bottleneck while decoding
-    */
-    ct = codetree->tree2d[(treepos << 1) + READBIT(*bp, in)];
-    ++(*bp);
-    if(ct < codetree->numcodes) return ct; /*the symbol is decoded, return it*/
-    else treepos = ct - codetree->numcodes; /*symbol not yet decoded, instead move tree position*/
-
-    if(treepos >= codetree->numcodes) return (unsigned)(-1); /*error: it appeared outside the codetree*/
+    /*long code: the length in the first table is that of the subtable, look up the remaining bits there*/
+    advanceBits(reader, FIRSTBITS);
+    index = value + peekBits(reader, l - FIRSTBITS);
+    l = codetree->table_len[index] - FIRSTBITS;
+    value = codetree->table_value[index];
   }
+  advanceBits(reader, l);
+  if(reader->bp > reader->bitsize) return (unsigned)(-1); /*error: end of input memory reached without endcode*/
+  return value;
 }
 #endif /*LODEPNG_COMPILE_DECODER*/
 
@@ -980,13 +1179,11 @@ static void getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d)
 }
 
 /*get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
-                                      const unsigned char* in, size_t* bp, size_t inlength)
+static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d, BitReader* reader)
 {
   /*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated*/
   unsigned error = 0;
   unsigned n, HLIT, HDIST, HCLEN, i;
-  size_t inbitlength = inlength * 8;
 
   /*see comments in deflateDynamic for explanation of the context and these variables, it is analogous*/
   unsigned* bitlen_ll = 0; /*lit,len code lengths*/
@@ -995,16 +1192,18 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   unsigned* bitlen_cl = 0;
   HuffmanTree tree_cl; /*the code tree for code length codes (the huffman tree for compressed huffman trees)*/
 
-  if((*bp) + 14 > (inlength << 3)) return 49; /*error: the bit pointer is or will go past the memory*/
+  if(reader->bp + 14 > reader->bitsize) return 49; /*error: the bit pointer is or will go past the memory*/
+  refillBits(reader);
 
   /*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already*/
-  HLIT =  readBitsFromStream(bp, in, 5) + 257;
+  HLIT =  readBits(reader, 5) + 257;
   /*number of distance codes. Unlike the spec, the value 1 is added to it here already*/
-  HDIST = readBitsFromStream(bp, in, 5) + 1;
+  HDIST = readBits(reader, 5) + 1;
   /*number of code length codes. Unlike the spec, the value 4 is added to it here already*/
-  HCLEN = readBitsFromStream(bp, in, 4) + 4;
+  HCLEN = readBits(reader, 4) + 4;
 
-  if((*bp) + HCLEN * 3 > (inlength << 3)) return 50; /*error: the bit pointer is or will go past the memory*/
+  if(reader->bp + HCLEN * 3 > reader->bitsize) return 50; /*error: the bit pointer is or will go past the memory*/
+  refillBits(reader); /*the at most 19 * 3 = 57 code length code lengths fit in the buffer*/
 
   HuffmanTree_init(&tree_cl);
 
@@ -1017,7 +1216,7 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 
     for(i = 0; i != NUM_CODE_LENGTH_CODES; ++i)
     {
-      if(i < HCLEN) bitlen_cl[CLCL_ORDER[i]] = readBitsFromStream(bp, in, 3);
+      if(i < HCLEN) bitlen_cl[CLCL_ORDER[i]] = readBits(reader, 3);
       else bitlen_cl[CLCL_ORDER[i]] = 0; /*if not, it must stay 0*/
     }
 
@@ -1035,7 +1234,9 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     i = 0;
     while(i < HLIT + HDIST)
     {
-      unsigned code = huffmanDecodeSymbol(in, bp, &tree_cl, inbitlength);
+      unsigned code;
+      refillBits(reader); /*enough for the code and its at most 7 extra bits*/
+      code = huffmanDecodeSymbol(reader, &tree_cl);
       if(code <= 15) /*a length code*/
       {
         if(i < HLIT) bitlen_ll[i] = code;
@@ -1049,8 +1250,8 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 
         if(i == 0) ERROR_BREAK(54); /*can't repeat previous if i is 0*/
 
-        if((*bp + 2) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 2);
+        if((reader->bp + 2) > reader->bitsize) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
+        replength += readBits(reader, 2);
 
         if(i < HLIT + 1) value = bitlen_ll[i - 1];
         else value = bitlen_d[i - HLIT - 1];
@@ -1066,8 +1267,8 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
       else if(code == 17) /*repeat "0" 3-10 times*/
       {
         unsigned replength = 3; /*read in the bits that indicate repeat length*/
-        if((*bp + 3) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 3);
+        if((reader->bp + 3) > reader->bitsize) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
+        replength += readBits(reader, 3);
 
         /*repeat this value in the next lengths*/
         for(n = 0; n < replength; ++n)
@@ -1082,8 +1283,8 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
       else if(code == 18) /*repeat "0" 11-138 times*/
       {
         unsigned replength = 11; /*read in the bits that indicate repeat length*/
-        if((*bp + 7) > inbitlength) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
-        replength += readBitsFromStream(bp, in, 7);
+        if((reader->bp + 7) > reader->bitsize) ERROR_BREAK(50); /*error, bit pointer jumps past memory*/
+        replength += readBits(reader, 7);
 
         /*repeat this value in the next lengths*/
         for(n = 0; n < replength; ++n)
@@ -1101,7 +1302,7 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
         {
           /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
           (10=no endcode, 11=wrong jump outside of tree)*/
-          error = (*bp) > inbitlength ? 10 : 11;
+          error = reader->bp > reader->bitsize ? 10 : 11;
         }
         else error = 16; /*unexisting code, this can never happen*/
         break;
@@ -1127,29 +1328,106 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   return error;
 }
 
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len);
+
+/*the largest backward distance deflate can refer to*/
+#define INFLATE_WINDOW_SIZE 32768
+
+/*
+Receiver of the inflated data when decompressing in a streaming way. Instead of
+letting the output grow to the full decompressed size, the inflator hands out the
+data in front of the back-reference window each time the output reaches threshold
+bytes, and moves the remaining window to the start of the output buffer.
+*/
+typedef struct InflateSink
+{
+  /*must consume a prefix of the size bytes at data and set *consumed to its length. return value is error*/
+  unsigned (*flush)(void* context, const unsigned char* data, size_t size, size_t* consumed);
+  void* context;
+  size_t threshold; /*must be larger than INFLATE_WINDOW_SIZE*/
+  unsigned adler; /*adler32 checksum of all consumed data*/
+} InflateSink;
+
+/*pass the data that can no longer be referenced to the sink, or all data if final is set*/
+static unsigned inflateSink_flush(InflateSink* sink, ucvector* out, size_t* pos, unsigned final)
+{
+  size_t available = final ? *pos : (*pos > INFLATE_WINDOW_SIZE ? *pos - INFLATE_WINDOW_SIZE : 0);
+  size_t consumed = 0;
+  CERROR_TRY_RETURN(sink->flush(sink->context, out->data, available, &consumed));
+  /*the sink consumed data it wasn't given, or left over data at the end*/
+  if(consumed > available || (final && consumed != available)) return 91;
+  if(consumed != 0)
+  {
+    sink->adler = update_adler32(sink->adler, out->data, (unsigned)consumed);
+    memmove(out->data, out->data + consumed, *pos - consumed);
+    *pos -= consumed;
+    out->size = *pos;
+  }
+  return 0;
+}
+
+/*
+room the output buffer must have after pos to decode a symbol without checking its size:
+the longest match plus what the chunked copy below may write past its end
+*/
+#define INFLATE_FAST_MARGIN (258 + 16)
+
+/*copies a match of length bytes from distance bytes back, may write up to 15 bytes past its end*/
+static void inflateCopyMatch(unsigned char* out, size_t distance, size_t length)
+{
+  const unsigned char* in = out - distance;
+  size_t i;
+  if(distance >= 16)
+  {
+    /*each chunk only reads bytes that were written before it*/
+    for(i = 0; i < length; i += 16) memcpy(out + i, in + i, 16);
+  }
+  else if(distance >= 8)
+  {
+    for(i = 0; i < length; i += 8) memcpy(out + i, in + i, 8);
+  }
+  else if(distance == 1)
+  {
+    memset(out, in[0], length);
+  }
+  else
+  {
+    /*short repeating pattern, the bytes being copied are still being produced*/
+    for(i = 0; i != length; ++i) out[i] = in[i];
+  }
+}
+
 /*inflate a block with dynamic of fixed Huffman tree*/
-static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size_t* bp,
-                                    size_t* pos, size_t inlength, unsigned btype)
+static unsigned inflateHuffmanBlock(ucvector* out, BitReader* reader, size_t* pos, unsigned btype, InflateSink* sink)
 {
   unsigned error = 0;
   HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
   HuffmanTree tree_d; /*the huffman tree for distance codes*/
-  size_t inbitlength = inlength * 8;
 
   HuffmanTree_init(&tree_ll);
   HuffmanTree_init(&tree_d);
 
   if(btype == 1) getTreeInflateFixed(&tree_ll, &tree_d);
-  else if(btype == 2) error = getTreeInflateDynamic(&tree_ll, &tree_d, in, bp, inlength);
+  else if(btype == 2) error = getTreeInflateDynamic(&tree_ll, &tree_d, reader);
 
   while(!error) /*decode all symbols until end reached, breaks at end code*/
   {
     /*code_ll is literal, length or end code*/
-    unsigned code_ll = huffmanDecodeSymbol(in, bp, &tree_ll, inbitlength);
+    unsigned code_ll;
+    if(sink && *pos >= sink->threshold)
+    {
+      error = inflateSink_flush(sink, out, pos, 0);
+      if(error) break;
+    }
+    /*when the buffer is known to be large enough, it is only resized at the end of the block*/
+    if(*pos + INFLATE_FAST_MARGIN > out->allocsize && !ucvector_reserve(out, *pos + INFLATE_FAST_MARGIN))
+    {
+      ERROR_BREAK(83 /*alloc fail*/);
+    }
+    refillBits(reader);
+    code_ll = huffmanDecodeSymbol(reader, &tree_ll);
     if(code_ll <= 255) /*literal symbol*/
     {
-      /*ucvector_push_back would do the same, but for some reason the two lines below run 10% faster*/
-      if(!ucvector_resize(out, (*pos) + 1)) ERROR_BREAK(83 /*alloc fail*/);
       out->data[*pos] = (unsigned char)code_ll;
       ++(*pos);
     }
@@ -1157,25 +1435,25 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
     {
       unsigned code_d, distance;
       unsigned numextrabits_l, numextrabits_d; /*extra bits for length and distance*/
-      size_t start, forward, backward, length;
+      size_t length;
 
       /*part 1: get length base*/
       length = LENGTHBASE[code_ll - FIRST_LENGTH_CODE_INDEX];
 
       /*part 2: get extra bits and add the value of that to length*/
       numextrabits_l = LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX];
-      if((*bp + numextrabits_l) > inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      length += readBitsFromStream(bp, in, numextrabits_l);
+      length += readBits(reader, numextrabits_l);
+      if(reader->bp > reader->bitsize) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
 
       /*part 3: get distance code*/
-      code_d = huffmanDecodeSymbol(in, bp, &tree_d, inbitlength);
+      code_d = huffmanDecodeSymbol(reader, &tree_d);
       if(code_d > 29)
       {
         if(code_d == (unsigned)(-1)) /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/
         {
           /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
           (10=no endcode, 11=wrong jump outside of tree)*/
-          error = (*bp) > inlength * 8 ? 10 : 11;
+          error = reader->bp > reader->bitsize ? 10 : 11;
         }
         else error = 18; /*error: invalid distance code (30-31 are never used)*/
         break;
@@ -1184,24 +1462,13 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
 
       /*part 4: get extra bits from distance*/
       numextrabits_d = DISTANCEEXTRA[code_d];
-      if((*bp + numextrabits_d) > inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      distance += readBitsFromStream(bp, in, numextrabits_d);
+      distance += readBits(reader, numextrabits_d);
+      if(reader->bp > reader->bitsize) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
 
       /*part 5: fill in all the out[n] values based on the length and dist*/
-      start = (*pos);
-      if(distance > start) ERROR_BREAK(52); /*too long backward distance*/
-      backward = start - distance;
-
-      if(!ucvector_resize(out, (*pos) + length)) ERROR_BREAK(83 /*alloc fail*/);
-      if (distance < length) {
-        for(forward = 0; forward < length; ++forward)
-        {
-          out->data[(*pos)++] = out->data[backward++];
-        }
-      } else {
-        memcpy(out->data + *pos, out->data + backward, length);
-        *pos += length;
-      }
+      if(distance > *pos) ERROR_BREAK(52); /*too long backward distance*/
+      inflateCopyMatch(out->data + *pos, distance, length);
+      *pos += length;
     }
     else if(code_ll == 256)
     {
@@ -1211,10 +1478,11 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
     {
       /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
       (10=no endcode, 11=wrong jump outside of tree)*/
-      error = ((*bp) > inlength * 8) ? 10 : 11;
+      error = reader->bp > reader->bitsize ? 10 : 11;
       break;
     }
   }
+  out->size = *pos;
 
   HuffmanTree_cleanup(&tree_ll);
   HuffmanTree_cleanup(&tree_d);
@@ -1222,14 +1490,15 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   return error;
 }
 
-static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength)
+static unsigned inflateNoCompression(ucvector* out, BitReader* reader, size_t* pos)
 {
   size_t p;
-  unsigned LEN, NLEN, n, error = 0;
+  unsigned LEN, NLEN, error = 0;
+  const unsigned char* in = reader->data;
+  size_t inlength = reader->size;
 
   /*go to first boundary of byte*/
-  while(((*bp) & 0x7) != 0) ++(*bp);
-  p = (*bp) / 8; /*byte position*/
+  p = (reader->bp + 7u) >> 3u; /*byte position*/
 
   /*read LEN (2 bytes) and NLEN (2 bytes)*/
   if(p + 4 >= inlength) return 52; /*error, bit pointer will jump past memory*/
@@ -1243,40 +1512,45 @@ static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, siz
 
   /*read the literal data: LEN bytes are now stored in the out buffer*/
   if(p + LEN > inlength) return 23; /*error: reading outside of in buffer*/
-  for(n = 0; n < LEN; ++n) out->data[(*pos)++] = in[p++];
+  memcpy(out->data + *pos, in + p, LEN);
+  *pos += LEN;
+  p += LEN;
 
-  (*bp) = p * 8;
+  reader->bp = p * 8;
 
   return error;
 }
 
+/*if sink is given, the output is streamed to it and out only holds the current window*/
 static unsigned lodepng_inflatev(ucvector* out,
                                  const unsigned char* in, size_t insize,
-                                 const LodePNGDecompressSettings* settings)
+                                 const LodePNGDecompressSettings* settings, InflateSink* sink)
 {
-  /*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
-  size_t bp = 0;
+  BitReader reader;
   unsigned BFINAL = 0;
   size_t pos = 0; /*byte position in the out buffer*/
-  unsigned error = 0;
+  unsigned error = BitReader_init(&reader, in, insize);
 
   (void)settings;
+  if(error) return error;
 
   while(!BFINAL)
   {
     unsigned BTYPE;
-    if(bp + 2 >= insize * 8) return 52; /*error, bit pointer will jump past memory*/
-    BFINAL = readBitFromStream(&bp, in);
-    BTYPE = 1u * readBitFromStream(&bp, in);
-    BTYPE += 2u * readBitFromStream(&bp, in);
+    if(reader.bp + 2 >= reader.bitsize) return 52; /*error, bit pointer will jump past memory*/
+    refillBits(&reader);
+    BFINAL = readBits(&reader, 1);
+    BTYPE = readBits(&reader, 2);
 
     if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
-    else if(BTYPE == 0) error = inflateNoCompression(out, in, &bp, &pos, insize); /*no compression*/
-    else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
+    else if(BTYPE == 0) error = inflateNoCompression(out, &reader, &pos); /*no compression*/
+    else error = inflateHuffmanBlock(out, &reader, &pos, BTYPE, sink); /*compression, BTYPE 01 or 10*/
 
+    if(!error && sink && pos >= sink->threshold) error = inflateSink_flush(sink, out, &pos, 0);
     if(error) return error;
   }
 
+  if(sink) error = inflateSink_flush(sink, out, &pos, 1);
   return error;
 }
 
@@ -1287,23 +1561,25 @@ unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
   unsigned error;
   ucvector v;
   ucvector_init_buffer(&v, *out, *outsize);
-  error = lodepng_inflatev(&v, in, insize, settings);
+  error = lodepng_inflatev(&v, in, insize, settings, 0);
   *out = v.data;
   *outsize = v.size;
   return error;
 }
 
-static unsigned inflate(unsigned char** out, size_t* outsize,
-                        const unsigned char* in, size_t insize,
-                        const LodePNGDecompressSettings* settings)
+static unsigned inflatev(ucvector* out,
+                         const unsigned char* in, size_t insize,
+                         const LodePNGDecompressSettings* settings)
 {
   if(settings->custom_inflate)
   {
-    return settings->custom_inflate(out, outsize, in, insize, settings);
+    unsigned error = settings->custom_inflate(&out->data, &out->size, in, insize, settings);
+    out->allocsize = out->size;
+    return error;
   }
   else
   {
-    return lodepng_inflate(out, outsize, in, insize, settings);
+    return lodepng_inflatev(out, in, insize, settings, 0);
   }
 }
 
@@ -1340,23 +1616,72 @@ static size_t searchCodeIndex(const unsigned* array, size_t array_size, size_t v
   return left;
 }
 
-static void addLengthDistance(uivector* values, size_t length, size_t distance)
+/*
+The LZ77 encoded data holds one token per literal or length/distance pair:
+0-255: literal bytes
+256: end
+257-285: length/distance pair, with the length code in the lowest 9 bits, followed by
+5 bits of extra length bits, 5 bits of distance code and 13 bits of extra distance bits
+*/
+static unsigned lengthDistanceToken(size_t length, size_t distance)
 {
-  /*values in encoded vector are those used by deflate:
-  0-255: literal bytes
-  256: end
-  257-285: length/distance pair (length code, followed by extra length bits, distance code, extra distance bits)
-  286-287: invalid*/
-
   unsigned length_code = (unsigned)searchCodeIndex(LENGTHBASE, 29, length);
   unsigned extra_length = (unsigned)(length - LENGTHBASE[length_code]);
   unsigned dist_code = (unsigned)searchCodeIndex(DISTANCEBASE, 30, distance);
   unsigned extra_distance = (unsigned)(distance - DISTANCEBASE[dist_code]);
 
-  uivector_push_back(values, length_code + FIRST_LENGTH_CODE_INDEX);
-  uivector_push_back(values, extra_length);
-  uivector_push_back(values, dist_code);
-  uivector_push_back(values, extra_distance);
+  return (length_code + FIRST_LENGTH_CODE_INDEX) | (extra_length << 9) | (dist_code << 14) | (extra_distance << 19);
+}
+
+static unsigned tokenSymbol(unsigned token) { return token & 511u; }
+static unsigned tokenLengthExtra(unsigned token) { return (token >> 9) & 31u; }
+static unsigned tokenDistanceCode(unsigned token) { return (token >> 14) & 31u; }
+static unsigned tokenDistanceExtra(unsigned token) { return token >> 19; }
+
+/*
+Returns the end of the run of equal bytes starting at fore and back, which is at
+most end. Compares 16 bytes at a time with SSE2, or 8 bytes at a time on other
+little endian CPUs, where the lowest set bit of the difference is the first
+unequal byte. Reads go no further than end, and back must come before fore.
+*/
+static const unsigned char* matchEnd(const unsigned char* back, const unsigned char* fore, const unsigned char* end)
+{
+#if defined(LODEPNG_SIMD_X86)
+  while(end - fore >= 16)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)back);
+    __m128i b = _mm_loadu_si128((const __m128i*)fore);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xffffu;
+    if(mask)
+    {
+#ifdef _MSC_VER
+      unsigned long index;
+      _BitScanForward(&index, mask);
+      return fore + index;
+#else /*_MSC_VER*/
+      return fore + __builtin_ctz(mask);
+#endif /*_MSC_VER*/
+    }
+    back += 16;
+    fore += 16;
+  }
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while(end - fore >= 8)
+  {
+    unsigned long long a, b;
+    memcpy(&a, back, 8);
+    memcpy(&b, fore, 8);
+    if(a != b) return fore + (__builtin_ctzll(a ^ b) >> 3);
+    back += 8;
+    fore += 8;
+  }
+#endif
+  while(fore != end && *back == *fore)
+  {
+    ++back;
+    ++fore;
+  }
+  return fore;
 }
 
 /*3 bytes of data get encoded into two bytes. The hash cannot use more than 3
@@ -1462,6 +1787,35 @@ static void updateHashChain(Hash* hash, size_t wpos, unsigned hashval, unsigned
   hash->headz[numzeros] = (unsigned)wpos;
 }
 
+/*
+Adds the positions from start to end to the hash chains without encoding them, so
+that the data after end can refer back to them. Only the last windowsize positions
+can be referred to, so the ones before are skipped.
+*/
+static unsigned hash_prime(Hash* hash, const unsigned char* in, size_t start, size_t end, unsigned windowsize)
+{
+  size_t pos;
+  unsigned numzeros = 0;
+  if(windowsize == 0 || windowsize > 32768) return 60; /*error: windowsize smaller/larger than allowed*/
+  if((windowsize & (windowsize - 1)) != 0) return 90; /*error: must be power of two*/
+  if(end - start > windowsize) start = end - windowsize;
+  for(pos = start; pos < end; ++pos)
+  {
+    unsigned hashval = getHash(in, end, pos);
+    if(hashval == 0)
+    {
+      if(numzeros == 0) numzeros = countZeros(in, end, pos);
+      else if(pos + numzeros > end || in[pos + numzeros - 1] != 0) --numzeros;
+    }
+    else
+    {
+      numzeros = 0;
+    }
+    updateHashChain(hash, pos & (windowsize - 1), hashval, numzeros);
+  }
+  return 0;
+}
+
 /*
 LZ77-encode the data. Return value is error code. The input are raw bytes, the output
 is in the form of unsigned integers with codes representing for example literal bytes, or
@@ -1473,12 +1827,11 @@ this hash technique is one out of several ways to speed this up.
 */
 static unsigned encodeLZ77(uivector* out, Hash* hash,
                            const unsigned char* in, size_t inpos, size_t insize, unsigned windowsize,
-                           unsigned minmatch, unsigned nicematch, unsigned lazymatching)
+                           unsigned minmatch, unsigned nicematch, unsigned lazymatching, unsigned maxchainlength)
 {
   size_t pos;
   unsigned i, error = 0;
-  /*for large window lengths, assume the user wants no compression loss. Otherwise, max hash chain length speedup.*/
-  unsigned maxchainlength = windowsize >= 8192 ? windowsize : windowsize / 8;
+  unsigned* tokens;
   unsigned maxlazymatch = windowsize >= 8192 ? MAX_SUPPORTED_DEFLATE_LENGTH : 64;
 
   unsigned usezeros = 1; /*not sure if setting it to false for windowsize < 8192 is better or worse*/
@@ -1498,6 +1851,12 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
   if((windowsize & (windowsize - 1)) != 0) return 90; /*error: must be power of two*/
 
   if(nicematch > MAX_SUPPORTED_DEFLATE_LENGTH) nicematch = MAX_SUPPORTED_DEFLATE_LENGTH;
+  /*for large window lengths, assume the user wants no compression loss. Otherwise, max hash chain length speedup.*/
+  if(maxchainlength == 0) maxchainlength = windowsize >= 8192 ? windowsize : windowsize / 8;
+
+  /*every token covers at least one byte, so the tokens of the whole input fit*/
+  if(inpos < insize && !uivector_reserve(out, (out->size + (insize - inpos)) * sizeof(unsigned))) return 83; /*alloc fail*/
+  tokens = out->data;
 
   for(pos = inpos; pos < insize; ++pos)
   {
@@ -1550,11 +1909,7 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
           foreptr += skip;
         }
 
-        while(foreptr != lastptr && *backptr == *foreptr) /*maximum supported length by deflate is max length*/
-        {
-          ++backptr;
-          ++foreptr;
-        }
+        foreptr = matchEnd(backptr, foreptr, lastptr); /*maximum supported length by deflate is max length*/
         current_length = (unsigned)(foreptr - &in[pos]);
 
         if(current_length > length)
@@ -1598,7 +1953,7 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
         if(length > lazylength + 1)
         {
           /*push the previous character as literal*/
-          if(!uivector_push_back(out, in[pos - 1])) ERROR_BREAK(83 /*alloc fail*/);
+          tokens[out->size++] = in[pos - 1];
         }
         else
         {
@@ -1615,17 +1970,17 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
     /*encode it as length/distance pair or literal value*/
     if(length < 3) /*only lengths of 3 or higher are supported as length/distance pair*/
     {
-      if(!uivector_push_back(out, in[pos])) ERROR_BREAK(83 /*alloc fail*/);
+      tokens[out->size++] = in[pos];
     }
     else if(length < minmatch || (length == 3 && offset > 4096))
     {
       /*compensate for the fact that longer offsets have more extra bits, a
       length of only 3 may be not worth it then*/
-      if(!uivector_push_back(out, in[pos])) ERROR_BREAK(83 /*alloc fail*/);
+      tokens[out->size++] = in[pos];
     }
     else
     {
-      addLengthDistance(out, length, offset);
+      tokens[out->size++] = lengthDistanceToken(length, offset);
       for(i = 1; i < length; ++i)
       {
         ++pos;
@@ -1650,19 +2005,20 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 
 /* /////////////////////////////////////////////////////////////////////////// */
 
-static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize)
+static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize, unsigned final)
 {
   /*non compressed deflate block data: 1 bit BFINAL,2 bits BTYPE,(5 bits): it jumps to start of next byte,
   2 bytes LEN, 2 bytes NLEN, LEN bytes literal DATA*/
 
   size_t i, j, numdeflateblocks = (datasize + 65534) / 65535;
   unsigned datapos = 0;
+  if(numdeflateblocks == 0 && final) numdeflateblocks = 1; /*an empty final block ends an empty stream*/
   for(i = 0; i != numdeflateblocks; ++i)
   {
     unsigned BFINAL, BTYPE, LEN, NLEN;
     unsigned char firstbyte;
 
-    BFINAL = (i == numdeflateblocks - 1);
+    BFINAL = final && (i == numdeflateblocks - 1);
     BTYPE = 0;
 
     firstbyte = (unsigned char)(BFINAL + ((BTYPE & 1) << 1) + ((BTYPE & 2) << 1));
@@ -1698,19 +2054,20 @@ static void writeLZ77data(size_t* bp, ucvector* out, const uivector* lz77_encode
   size_t i = 0;
   for(i = 0; i != lz77_encoded->size; ++i)
   {
-    unsigned val = lz77_encoded->data[i];
+    unsigned token = lz77_encoded->data[i];
+    unsigned val = tokenSymbol(token);
     addHuffmanSymbol(bp, out, HuffmanTree_getCode(tree_ll, val), HuffmanTree_getLength(tree_ll, val));
     if(val > 256) /*for a length code, 3 more things have to be added*/
     {
       unsigned length_index = val - FIRST_LENGTH_CODE_INDEX;
       unsigned n_length_extra_bits = LENGTHEXTRA[length_index];
-      unsigned length_extra_bits = lz77_encoded->data[++i];
+      unsigned length_extra_bits = tokenLengthExtra(token);
 
-      unsigned distance_code = lz77_encoded->data[++i];
+      unsigned distance_code = tokenDistanceCode(token);
 
       unsigned distance_index = distance_code;
       unsigned n_distance_extra_bits = DISTANCEEXTRA[distance_index];
-      unsigned distance_extra_bits = lz77_encoded->data[++i];
+      unsigned distance_extra_bits = tokenDistanceExtra(token);
 
       addBitsToStream(bp, out, length_extra_bits, n_length_extra_bits);
       addHuffmanSymbol(bp, out, HuffmanTree_getCode(tree_d, distance_code),
@@ -1783,7 +2140,8 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
     if(settings->use_lz77)
     {
       error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                         settings->minmatch, settings->nicematch, settings->lazymatching);
+                         settings->minmatch, settings->nicematch, settings->lazymatching,
+                         settings->maxchainlength);
       if(error) break;
     }
     else
@@ -1798,14 +2156,9 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
     /*Count the frequencies of lit, len and dist codes*/
     for(i = 0; i != lz77_encoded.size; ++i)
     {
-      unsigned symbol = lz77_encoded.data[i];
+      unsigned symbol = tokenSymbol(lz77_encoded.data[i]);
       ++frequencies_ll.data[symbol];
-      if(symbol > 256)
-      {
-        unsigned dist = lz77_encoded.data[i + 2];
-        ++frequencies_d.data[dist];
-        i += 3;
-      }
+      if(symbol > 256) ++frequencies_d.data[tokenDistanceCode(lz77_encoded.data[i])];
     }
     frequencies_ll.data[256] = 1; /*there will be exactly 1 end code, at the end of the block*/
 
@@ -1993,7 +2346,8 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
     uivector lz77_encoded;
     uivector_init(&lz77_encoded);
     error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                       settings->minmatch, settings->nicematch, settings->lazymatching);
+                       settings->minmatch, settings->nicematch, settings->lazymatching,
+                       settings->maxchainlength);
     if(!error) writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
     uivector_cleanup(&lz77_encoded);
   }
@@ -2014,8 +2368,13 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   return error;
 }
 
-static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings)
+/*
+Deflates in[start, end) out of the total input in[0, insize). The data before start
+is used as the dictionary for matches. If end is not insize, the last block is not
+final, and an empty stored block follows it to end the output on a byte boundary.
+*/
+static unsigned deflateRange(ucvector* out, const unsigned char* in, size_t insize,
+                             size_t start, size_t end, const LodePNGCompressSettings* settings)
 {
   unsigned error = 0;
   size_t i, blocksize, numdeflateblocks;
@@ -2023,8 +2382,8 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   Hash hash;
 
   if(settings->btype > 2) return 61;
-  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
-  else if(settings->btype == 1) blocksize = insize;
+  else if(settings->btype == 0) return deflateNoCompression(out, in + start, end - start, end == insize);
+  else if(settings->btype == 1) blocksize = end - start;
   else /*if(settings->btype == 2)*/
   {
     /*on PNGs, deflate blocks of 65-262k seem to give most dense encoding*/
@@ -2033,21 +2392,30 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
     if(blocksize > 262144) blocksize = 262144;
   }
 
-  numdeflateblocks = (insize + blocksize - 1) / blocksize;
-  if(numdeflateblocks == 0) numdeflateblocks = 1;
+  numdeflateblocks = start == end ? 1 : (end - start + blocksize - 1) / blocksize;
 
   error = hash_init(&hash, settings->windowsize);
   if(error) return error;
 
+  if(settings->use_lz77 && start != 0) error = hash_prime(&hash, in, 0, start, settings->windowsize);
+
   for(i = 0; i != numdeflateblocks && !error; ++i)
   {
-    unsigned final = (i == numdeflateblocks - 1);
-    size_t start = i * blocksize;
-    size_t end = start + blocksize;
-    if(end > insize) end = insize;
+    unsigned final = (i == numdeflateblocks - 1) && end == insize;
+    size_t blockstart = start + i * blocksize;
+    size_t blockend = blockstart + blocksize;
+    if(blockend > end) blockend = end;
 
-    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final);
-    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
+    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, blockstart, blockend, settings, final);
+    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, blockstart, blockend, settings, final);
+  }
+
+  if(!error && end != insize)
+  {
+    /*empty non-final stored block: 3 header bits, padding to the byte boundary, LEN 0 and NLEN 65535*/
+    addBitsToStream(&bp, out, 0, 3);
+    if(!ucvector_push_back(out, 0) || !ucvector_push_back(out, 0)
+       || !ucvector_push_back(out, 255) || !ucvector_push_back(out, 255)) error = 83; /*alloc fail*/
   }
 
   hash_cleanup(&hash);
@@ -2055,6 +2423,12 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   return error;
 }
 
+static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
+                                 const LodePNGCompressSettings* settings)
+{
+  return deflateRange(out, in, insize, 0, insize, settings);
+}
+
 unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings)
@@ -2068,6 +2442,20 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
   return error;
 }
 
+unsigned lodepng_deflate_range(unsigned char** out, size_t* outsize,
+                               const unsigned char* in, size_t insize, size_t start, size_t end,
+                               const LodePNGCompressSettings* settings)
+{
+  unsigned error;
+  ucvector v;
+  if(start > end || end > insize) return 98; /*invalid range*/
+  ucvector_init_buffer(&v, *out, *outsize);
+  error = deflateRange(&v, in, insize, start, end, settings);
+  *out = v.data;
+  *outsize = v.size;
+  return error;
+}
+
 static unsigned deflate(unsigned char** out, size_t* outsize,
                         const unsigned char* in, size_t insize,
                         const LodePNGCompressSettings* settings)
@@ -2088,7 +2476,10 @@ static unsigned deflate(unsigned char** out, size_t* outsize,
 /* / Adler32                                                                  */
 /* ////////////////////////////////////////////////////////////////////////// */
 
-static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len)
+/*the largest number of bytes that can be summed before s2 can overflow 32 bits*/
+#define ADLER32_NMAX 5552
+
+static unsigned update_adler32_scalar(unsigned adler, const unsigned char* data, unsigned len)
 {
    unsigned s1 = adler & 0xffff;
    unsigned s2 = (adler >> 16) & 0xffff;
@@ -2111,22 +2502,109 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
   return (s2 << 16) | s1;
 }
 
-/*Return the adler32 of the bytes data[0..len-1]*/
+#ifdef LODEPNG_SIMD_X86
+static unsigned sum32_SSE2(__m128i v)
+{
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return (unsigned)_mm_cvtsi128_si32(v);
+}
+
+/*
+Sums blocks of 16 bytes at once: s1 with _mm_sad_epu8, and the bytes weighted
+by their distance to the end of the block for s2 with _mm_madd_epi16. Each block
+also adds 16 times the byte sum of the blocks before it to s2.
+*/
+static unsigned update_adler32_SSE2(unsigned adler, const unsigned char* data, unsigned len)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i weights_lo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+  const __m128i weights_hi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+  unsigned s1 = adler & 0xffff;
+  unsigned s2 = (adler >> 16) & 0xffff;
+
+  while(len >= 16)
+  {
+    unsigned blocks = (len > ADLER32_NMAX ? ADLER32_NMAX : len) / 16;
+    __m128i v_s1 = zero; /*byte sum of the blocks so far*/
+    __m128i v_ps = zero; /*sum of v_s1 before each block*/
+    __m128i v_s2 = zero; /*weighted sums within each block*/
+    unsigned i;
+    len -= blocks * 16;
+    for(i = 0; i != blocks; ++i)
+    {
+      __m128i bytes = _mm_loadu_si128((const __m128i*)data);
+      v_ps = _mm_add_epi32(v_ps, v_s1);
+      v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes, zero));
+      v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weights_lo));
+      v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weights_hi));
+      data += 16;
+    }
+    s2 = (unsigned)((s2 + (unsigned long long)blocks * 16u * s1 + 16u * (unsigned long long)sum32_SSE2(v_ps)
+                    + sum32_SSE2(v_s2)) % 65521u);
+    s1 = (s1 + sum32_SSE2(v_s1)) % 65521u;
+  }
+
+  return update_adler32_scalar((s2 << 16) | s1, data, len);
+}
+#endif /*LODEPNG_SIMD_X86*/
+
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len)
+{
+#ifdef LODEPNG_SIMD_X86
+  if(lodepng_cpu_features() & LODEPNG_CPU_SSE2) return update_adler32_SSE2(adler, data, len);
+#endif /*LODEPNG_SIMD_X86*/
+  return update_adler32_scalar(adler, data, len);
+}
+
 static unsigned adler32(const unsigned char* data, unsigned len)
 {
   return update_adler32(1L, data, len);
 }
 
+#ifdef LODEPNG_COMPILE_ENCODER
+
+unsigned lodepng_update_adler32(unsigned adler, const unsigned char* data, size_t len)
+{
+  while(len > 0)
+  {
+    unsigned amount = len > 0x40000000u ? 0x40000000u : (unsigned)len;
+    adler = update_adler32(adler, data, amount);
+    data += amount;
+    len -= amount;
+  }
+  return adler;
+}
+
+/*
+Appending len2 bytes to the first range adds their byte sum to s1, and to s2 their
+weighted sum plus len2 times the s1 of the first range, counting its initial 1 once.
+*/
+unsigned lodepng_adler32_combine(unsigned adler1, unsigned adler2, size_t len2)
+{
+  unsigned rem = (unsigned)(len2 % 65521u);
+  unsigned s1 = adler1 & 0xffff;
+  unsigned s2 = (unsigned)(((unsigned long long)rem * s1) % 65521u);
+  s1 += (adler2 & 0xffff) + 65521u - 1u;
+  s2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + 65521u - rem;
+  if(s1 >= 65521u) s1 -= 65521u;
+  if(s1 >= 65521u) s1 -= 65521u;
+  if(s2 >= 2u * 65521u) s2 -= 2u * 65521u;
+  if(s2 >= 65521u) s2 -= 65521u;
+  return (s2 << 16) | s1;
+}
+
+#endif /*LODEPNG_COMPILE_ENCODER*/
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Zlib                                                                   / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                                 size_t insize, const LodePNGDecompressSettings* settings)
+/*check the 2-byte zlib header in front of the deflate data. return value is error*/
+static unsigned zlib_checkHeader(const unsigned char* in, size_t insize)
 {
-  unsigned error = 0;
   unsigned CM, CINFO, FDICT;
 
   if(insize < 2) return 53; /*error, size of zlib data too small*/
@@ -2155,21 +2633,63 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
     return 26;
   }
 
-  error = inflate(out, outsize, in + 2, insize - 2, settings);
+  return 0;
+}
+
+static unsigned zlib_decompressv(ucvector* out, const unsigned char* in,
+                                 size_t insize, const LodePNGDecompressSettings* settings)
+{
+  unsigned error = zlib_checkHeader(in, insize);
+  if(error) return error;
+
+  error = inflatev(out, in + 2, insize - 2, settings);
   if(error) return error;
 
   if(!settings->ignore_adler32)
   {
     unsigned ADLER32 = lodepng_read32bitInt(&in[insize - 4]);
-    unsigned checksum = adler32(*out, (unsigned)(*outsize));
+    unsigned checksum = adler32(out->data, (unsigned)(out->size));
     if(checksum != ADLER32) return 58; /*error, adler checksum not correct, data must be corrupted*/
   }
 
   return 0; /*no error*/
 }
 
-static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                                size_t insize, const LodePNGDecompressSettings* settings)
+unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                                 size_t insize, const LodePNGDecompressSettings* settings)
+{
+  unsigned error;
+  ucvector v;
+  ucvector_init_buffer(&v, *out, *outsize);
+  error = zlib_decompressv(&v, in, insize, settings);
+  *out = v.data;
+  *outsize = v.size;
+  return error;
+}
+
+/*streaming version of lodepng_zlib_decompress, see InflateSink. window is the buffer for the back-references*/
+static unsigned zlib_decompressToSink(ucvector* window, InflateSink* sink, const unsigned char* in,
+                                      size_t insize, const LodePNGDecompressSettings* settings)
+{
+  unsigned error = zlib_checkHeader(in, insize);
+  if(error) return error;
+
+  sink->adler = 1;
+  error = lodepng_inflatev(window, in + 2, insize - 2, settings, sink);
+  if(error) return error;
+
+  if(!settings->ignore_adler32)
+  {
+    unsigned ADLER32 = lodepng_read32bitInt(&in[insize - 4]);
+    if(sink->adler != ADLER32) return 58; /*error, adler checksum not correct, data must be corrupted*/
+  }
+
+  return 0; /*no error*/
+}
+
+/*expected_size is the decompressed size if known, or 0. The output buffer is then allocated once up front*/
+static unsigned zlib_decompress(unsigned char** out, size_t* outsize, size_t expected_size,
+                                const unsigned char* in, size_t insize, const LodePNGDecompressSettings* settings)
 {
   if(settings->custom_zlib)
   {
@@ -2177,7 +2697,15 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
   }
   else
   {
-    return lodepng_zlib_decompress(out, outsize, in, insize, settings);
+    unsigned error = 0;
+    ucvector v;
+    ucvector_init_buffer(&v, *out, *outsize);
+    /*with the margin, the inflator never has to grow the buffer while decoding valid data*/
+    if(expected_size != 0 && !ucvector_reserve(&v, v.size + expected_size + INFLATE_FAST_MARGIN)) error = 83;
+    if(!error) error = zlib_decompressv(&v, in, insize, settings);
+    *out = v.data;
+    *outsize = v.size;
+    return error;
   }
 }
 
@@ -2245,9 +2773,10 @@ static unsigned zlib_compress(unsigned char** out, size_t* outsize, const unsign
 #else /*no LODEPNG_COMPILE_ZLIB*/
 
 #ifdef LODEPNG_COMPILE_DECODER
-static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                                size_t insize, const LodePNGDecompressSettings* settings)
+static unsigned zlib_decompress(unsigned char** out, size_t* outsize, size_t expected_size,
+                                const unsigned char* in, size_t insize, const LodePNGDecompressSettings* settings)
 {
+  (void)expected_size;
   if(!settings->custom_zlib) return 87; /*no custom zlib function provided */
   return settings->custom_zlib(out, outsize, in, insize, settings);
 }
@@ -2279,13 +2808,14 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings)
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->maxchainlength = 0;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -2355,15 +2885,356 @@ static unsigned lodepng_crc32_table[256] = {
   3009837614u, 3294710456u, 1567103746u,  711928724u, 3020668471u, 3272380065u, 1510334235u,  755167117u
 };
 
+/*
+Tables for slicing-by-8: lodepng_crc32_slices[k - 1][b] is the CRC register after byte b
+followed by k zero bytes, with lodepng_crc32_table for k = 0. This way 8 bytes can be
+processed at once with one independent lookup each.
+*/
+static const unsigned lodepng_crc32_slices[7][256] = {
+  {
+             0u,  421212481u,  842424962u,  724390851u, 1684849924u, 2105013317u, 1448781702u, 1329698503u,
+    3369699848u, 3519200073u, 4210026634u, 3824474571u, 2897563404u, 3048111693u, 2659397006u, 2274893007u,
+    1254232657u, 1406739216u, 2029285587u, 1643069842u,  783210325u,  934667796u,  479770071u,   92505238u,
+    2182846553u, 2600511768u, 2955803355u, 2838940570u, 3866582365u, 4285295644u, 3561045983u, 3445231262u,
+    2508465314u, 2359236067u, 2813478432u, 3198777185u, 4058571174u, 3908292839u, 3286139684u, 3670389349u,
+    1566420650u, 1145479147u, 1869335592u, 1987116393u,  959540142u,  539646703u,  185010476u,  303839341u,
+    3745920755u, 3327985586u, 3983561841u, 4100678960u, 3140154359u, 2721170102u, 2300350837u, 2416418868u,
+     396344571u,  243568058u,  631889529u, 1018359608u, 1945336319u, 1793607870u, 1103436669u, 1490954812u,
+    4034481925u, 3915546180u, 3259968903u, 3679722694u, 2484439553u, 2366552896u, 2787371139u, 3208174018u,
+     950060301u,  565965900u,  177645455u,  328046286u, 1556873225u, 1171730760u, 1861902987u, 2011255754u,
+    3132841300u, 2745199637u, 2290958294u, 2442530455u, 3738671184u, 3352078609u, 3974232786u, 4126854035u,
+    1919080284u, 1803150877u, 1079293406u, 1498383519u,  370020952u,  253043481u,  607678682u, 1025720731u,
+    1711106983u, 2095471334u, 1472923941u, 1322268772u,   26324643u,  411738082u,  866634785u,  717028704u,
+    2904875439u, 3024081134u, 2668790573u, 2248782444u, 3376948395u, 3495106026u, 4219356713u, 3798300520u,
+     792689142u,  908347575u,  487136116u,   68299317u, 1263779058u, 1380486579u, 2036719216u, 1618931505u,
+    3890672638u, 4278043327u, 3587215740u, 3435896893u, 2206873338u, 2593195963u, 2981909624u, 2829542713u,
+     998479947u,  580430090u,  162921161u,  279890824u, 1609522511u, 1190423566u, 1842954189u, 1958874764u,
+    4082766403u, 3930137346u, 3245109441u, 3631694208u, 2536953671u, 2385372678u, 2768287173u, 3155920004u,
+    1900120602u, 1750776667u, 1131931800u, 1517083097u,  355290910u,  204897887u,  656092572u, 1040194781u,
+    3113746450u, 2692952403u, 2343461520u, 2461357009u, 3723805974u, 3304059991u, 4022511508u, 4141455061u,
+    2919742697u, 3072101800u, 2620513899u, 2234183466u, 3396041197u, 3547351212u, 4166851439u, 3779471918u,
+    1725839073u, 2143618976u, 1424512099u, 1307796770u,   45282277u,  464110244u,  813994343u,  698327078u,
+    3838160568u, 4259225593u, 3606301754u, 3488152955u, 2158586812u, 2578602749u, 2996767038u, 2877569151u,
+     740041904u,  889656817u,  506086962u,  120682355u, 1215357364u, 1366020341u, 2051441462u, 1667084919u,
+    3422213966u, 3538019855u, 4190942668u, 3772220557u, 2945847882u, 3062702859u, 2644537544u, 2226864521u,
+      52649286u,  439905287u,  823476164u,  672009861u, 1733269570u, 2119477507u, 1434057408u, 1281543041u,
+    2167981343u, 2552493150u, 3004082077u, 2853541596u, 3847487515u, 4233048410u, 3613549209u, 3464057816u,
+    1239502615u, 1358593622u, 2077699477u, 1657543892u,  764250643u,  882293586u,  532408465u,  111204816u,
+    1585378284u, 1197851309u, 1816695150u, 1968414767u,  974272232u,  587794345u,  136598634u,  289367339u,
+    2527558116u, 2411481253u, 2760973158u, 3179948583u, 4073438432u, 3956313505u, 3237863010u, 3655790371u,
+     347922877u,  229101820u,  646611775u, 1066513022u, 1892689081u, 1774917112u, 1122387515u, 1543337850u,
+    3697634229u, 3313392372u, 3998419255u, 4148705398u, 3087642289u, 2702352368u, 2319436851u, 2468674930u
+  },
+  {
+             0u,   29518391u,   59036782u,   38190681u,  118073564u,  114017003u,   76381362u,   89069189u,
+     236147128u,  265370511u,  228034006u,  206958561u,  152762724u,  148411219u,  178138378u,  190596925u,
+     472294256u,  501532999u,  530741022u,  509615401u,  456068012u,  451764635u,  413917122u,  426358261u,
+     305525448u,  334993663u,  296822438u,  275991697u,  356276756u,  352202787u,  381193850u,  393929805u,
+     944588512u,  965684439u, 1003065998u,  973863097u, 1061482044u, 1049003019u, 1019230802u, 1023561829u,
+     912136024u,  933002607u,  903529270u,  874031361u,  827834244u,  815125939u,  852716522u,  856752605u,
+     611050896u,  631869351u,  669987326u,  640506825u,  593644876u,  580921211u,  551983394u,  556069653u,
+     712553512u,  733666847u,  704405574u,  675154545u,  762387700u,  749958851u,  787859610u,  792175277u,
+    1889177024u, 1901651959u, 1931368878u, 1927033753u, 2006131996u, 1985040171u, 1947726194u, 1976933189u,
+    2122964088u, 2135668303u, 2098006038u, 2093965857u, 2038461604u, 2017599123u, 2047123658u, 2076625661u,
+    1824272048u, 1836991623u, 1866005214u, 1861914857u, 1807058540u, 1786244187u, 1748062722u, 1777547317u,
+    1655668488u, 1668093247u, 1630251878u, 1625932113u, 1705433044u, 1684323811u, 1713505210u, 1742760333u,
+    1222101792u, 1226154263u, 1263738702u, 1251046777u, 1339974652u, 1310460363u, 1281013650u, 1301863845u,
+    1187289752u, 1191637167u, 1161842422u, 1149379777u, 1103966788u, 1074747507u, 1112139306u, 1133218845u,
+    1425107024u, 1429406311u, 1467333694u, 1454888457u, 1408811148u, 1379576507u, 1350309090u, 1371438805u,
+    1524775400u, 1528845279u, 1499917702u, 1487177649u, 1575719220u, 1546255107u, 1584350554u, 1605185389u,
+    3778354048u, 3774312887u, 3803303918u, 3816007129u, 3862737756u, 3892238699u, 3854067506u, 3833203973u,
+    4012263992u, 4007927823u, 3970080342u, 3982554209u, 3895452388u, 3924658387u, 3953866378u, 3932773565u,
+    4245928176u, 4241609415u, 4271336606u, 4283762345u, 4196012076u, 4225268251u, 4187931714u, 4166823541u,
+    4076923208u, 4072833919u, 4035198246u, 4047918865u, 4094247316u, 4123732899u, 4153251322u, 4132437965u,
+    3648544096u, 3636082519u, 3673983246u, 3678331705u, 3732010428u, 3753090955u, 3723829714u, 3694611429u,
+    3614117080u, 3601426159u, 3572488374u, 3576541825u, 3496125444u, 3516976691u, 3555094634u, 3525581405u,
+    3311336976u, 3298595879u, 3336186494u, 3340255305u, 3260503756u, 3281337595u, 3251864226u, 3222399125u,
+    3410866088u, 3398419871u, 3368647622u, 3372945905u, 3427010420u, 3448139075u, 3485520666u, 3456284973u,
+    2444203584u, 2423127159u, 2452308526u, 2481530905u, 2527477404u, 2539934891u, 2502093554u, 2497740997u,
+    2679949304u, 2659102159u, 2620920726u, 2650438049u, 2562027300u, 2574714131u, 2603727690u, 2599670141u,
+    2374579504u, 2353749767u, 2383274334u, 2412743529u, 2323684844u, 2336421851u, 2298759554u, 2294686645u,
+    2207933576u, 2186809023u, 2149495014u, 2178734801u, 2224278612u, 2236720739u, 2266437690u, 2262135309u,
+    2850214048u, 2820717207u, 2858812622u, 2879680249u, 2934667388u, 2938704459u, 2909776914u, 2897069605u,
+    2817622296u, 2788420399u, 2759153014u, 2780249921u, 2700618180u, 2704950259u, 2742877610u, 2730399645u,
+    3049550800u, 3020298727u, 3057690558u, 3078802825u, 2999835404u, 3004150075u, 2974355298u, 2961925461u,
+    3151438440u, 3121956959u, 3092510214u, 3113327665u, 3168701108u, 3172786307u, 3210370778u, 3197646061u
+  },
+  {
+             0u, 3099354981u, 2852767883u,  313896942u, 2405603159u,  937357362u,  627793884u, 2648127673u,
+    3316918511u, 2097696650u, 1874714724u, 3607201537u, 1255587768u, 4067088605u, 3772741427u, 1482887254u,
+    1343838111u, 3903140090u, 4195393300u, 1118632049u, 3749429448u, 1741137837u, 1970407491u, 3452858150u,
+    2511175536u,  756094997u, 1067759611u, 2266550430u,  449832999u, 2725482306u, 2965774508u,  142231497u,
+    2687676222u,  412010587u,  171665333u, 2995192016u,  793786473u, 2548850444u, 2237264098u, 1038456711u,
+    1703315409u, 3711623348u, 3482275674u, 1999841343u, 3940814982u, 1381529571u, 1089329165u, 4166106984u,
+    4029413537u, 1217896388u, 1512189994u, 3802027855u, 2135519222u, 3354724499u, 3577784189u, 1845280792u,
+     899665998u, 2367928107u, 2677414085u,  657096608u, 3137160985u,   37822588u,  284462994u, 2823350519u,
+    2601801789u,  598228824u,  824021174u, 2309093331u,  343330666u, 2898962447u, 3195996129u,  113467524u,
+    1587572946u, 3860600759u, 4104763481u, 1276501820u, 3519211397u, 1769898208u, 2076913422u, 3279374443u,
+    3406630818u, 1941006535u, 1627703081u, 3652755532u, 1148164341u, 4241751952u, 3999682686u, 1457141531u,
+     247015245u, 3053797416u, 2763059142u,  470583459u, 2178658330u,  963106687u,  735213713u, 2473467892u,
+     992409347u, 2207944806u, 2435792776u,  697522413u, 3024379988u,  217581361u,  508405983u, 2800865210u,
+    4271038444u, 1177467017u, 1419450215u, 3962007554u, 1911572667u, 3377213406u, 3690561584u, 1665525589u,
+    1799331996u, 3548628985u, 3241568279u, 2039091058u, 3831314379u, 1558270126u, 1314193216u, 4142438437u,
+    2928380019u,  372764438u,   75645176u, 3158189981u,  568925988u, 2572515393u, 2346768303u,  861712586u,
+    3982079547u, 1441124702u, 1196457648u, 4293663189u, 1648042348u, 3666298377u, 3358779879u, 1888390786u,
+     686661332u, 2421291441u, 2196002399u,  978858298u, 2811169155u,  523464422u,  226935048u, 3040519789u,
+    3175145892u,  100435649u,  390670639u, 2952089162u,  841119475u, 2325614998u, 2553003640u,  546822429u,
+    2029308235u, 3225988654u, 3539796416u, 1782671013u, 4153826844u, 1328167289u, 1570739863u, 3844338162u,
+    1298864389u, 4124540512u, 3882013070u, 1608431339u, 3255406162u, 2058742071u, 1744848601u, 3501990332u,
+    2296328682u,  811816591u,  584513889u, 2590678532u,  129869501u, 3204563416u, 2914283062u,  352848211u,
+     494030490u, 2781751807u, 3078325777u,  264757620u, 2450577869u,  715964072u,  941166918u, 2158327331u,
+    3636881013u, 1618608400u, 1926213374u, 3396585883u, 1470427426u, 4011365959u, 4255988137u, 1158766284u,
+    1984818694u, 3471935843u, 3695453837u, 1693991400u, 4180638033u, 1100160564u, 1395044826u, 3952793279u,
+    3019491049u,  189112716u,  435162722u, 2706139399u, 1016811966u, 2217162459u, 2526189877u,  774831696u,
+     643086745u, 2666061564u, 2354934034u,  887166583u, 2838900430u,  294275499u,   54519365u, 3145957664u,
+    3823145334u, 1532818963u, 1240029693u, 4048895640u, 1820460577u, 3560857924u, 3331051178u, 2117577167u,
+    3598663992u, 1858283101u, 2088143283u, 3301633750u, 1495127663u, 3785470218u, 4078182116u, 1269332353u,
+     332098007u, 2876706482u, 3116540252u,   25085497u, 2628386432u,  605395429u,  916469259u, 2384220526u,
+    2254837415u, 1054503362u,  745528876u, 2496903497u,  151290352u, 2981684885u, 2735556987u,  464596510u,
+    1137851976u, 4218313005u, 3923506883u, 1365741990u, 3434129695u, 1946996346u, 1723425172u, 3724871409u
+  },
+  {
+             0u, 1029712304u, 2059424608u, 1201699536u, 4118849216u, 3370159984u, 2403399072u, 2988497936u,
+     812665793u,  219177585u, 1253054625u, 2010132753u, 3320900865u, 4170237105u, 3207642721u, 2186319825u,
+    1625331586u, 1568718386u,  438355170u,  658566482u, 2506109250u, 2818578674u, 4020265506u, 3535817618u,
+    1351670851u, 1844508147u,  709922595u,  389064339u, 2769320579u, 2557498163u, 3754961379u, 3803185235u,
+    3250663172u, 4238411444u, 3137436772u, 2254525908u,  876710340u,  153198708u, 1317132964u, 1944187668u,
+    4054934725u, 3436268917u, 2339452837u, 3054575125u,   70369797u,  961670069u, 2129760613u, 1133623509u,
+    2703341702u, 2621542710u, 3689016294u, 3867263574u, 1419845190u, 1774270454u,  778128678u,  318858390u,
+    2438067015u, 2888948471u, 3952189479u, 3606153623u, 1691440519u, 1504803895u,  504432359u,  594620247u,
+    1492342857u, 1704161785u,  573770537u,  525542041u, 2910060169u, 2417219385u, 3618876905u, 3939730521u,
+    1753420680u, 1440954936u,  306397416u,  790849880u, 2634265928u, 2690882808u, 3888375336u, 3668168600u,
+     940822475u,   91481723u, 1121164459u, 2142483739u, 3448989963u, 4042473659u, 3075684971u, 2318603227u,
+     140739594u,  889433530u, 1923340138u, 1338244826u, 4259521226u, 3229813626u, 2267247018u, 3124975642u,
+    2570221389u, 2756861693u, 3824297005u, 3734113693u, 1823658381u, 1372780605u,  376603373u,  722643805u,
+    2839690380u, 2485261628u, 3548540908u, 4007806556u, 1556257356u, 1638052860u,  637716780u,  459464860u,
+    4191346895u, 3300051327u, 2199040943u, 3195181599u,  206718479u,  825388991u, 1989285231u, 1274166495u,
+    3382881038u, 4106388158u, 3009607790u, 2382549470u, 1008864718u,   21111934u, 1189240494u, 2072147742u,
+    2984685714u, 2357631266u, 3408323570u, 4131834434u, 1147541074u, 2030452706u, 1051084082u,   63335554u,
+    2174155603u, 3170292451u, 4216760371u, 3325460867u, 1947622803u, 1232499747u,  248909555u,  867575619u,
+    3506841360u, 3966111392u, 2881909872u, 2527485376u,  612794832u,  434546784u, 1581699760u, 1663499008u,
+    3782634705u, 3692447073u, 2612412337u, 2799048193u,  351717905u,  697754529u, 1849071985u, 1398190273u,
+    1881644950u, 1296545318u,  182963446u,  931652934u, 2242328918u, 3100053734u, 4284967478u, 3255255942u,
+    1079497815u, 2100821479u,  983009079u,  133672583u, 3050795671u, 2293717799u, 3474399735u, 4067887175u,
+     281479188u,  765927844u, 1778867060u, 1466397380u, 3846680276u, 3626469220u, 2676489652u, 2733102084u,
+     548881365u,  500656741u, 1517752501u, 1729575173u, 3577210133u, 3898068133u, 2952246901u, 2459410373u,
+    3910527195u, 3564487019u, 2480257979u, 2931134987u,  479546907u,  569730987u, 1716854139u, 1530213579u,
+    3647316762u, 3825568426u, 2745561210u, 2663766474u,  753206746u,  293940330u, 1445287610u, 1799716618u,
+    2314567513u, 3029685993u, 4080348217u, 3461678473u, 2088098201u, 1091956777u,  112560889u, 1003856713u,
+    3112514712u, 2229607720u, 3276105720u, 4263857736u, 1275433560u, 1902492648u,  918929720u,  195422344u,
+     685033439u,  364179055u, 1377080511u, 1869921551u, 3713294623u, 3761522863u, 2811507327u, 2599689167u,
+     413436958u,  633644462u, 1650777982u, 1594160846u, 3978570462u, 3494118254u, 2548332990u, 2860797966u,
+    1211387997u, 1968470509u,  854852413u,  261368461u, 3182753437u, 2161434413u, 3346310653u, 4195650637u,
+    2017729436u, 1160000044u,   42223868u, 1071931724u, 2378480988u, 2963576044u, 4144295484u, 3395602316u
+  },
+  {
+             0u, 3411858341u, 1304994059u, 2257875630u, 2609988118u, 1355649459u, 3596215069u,  486879416u,
+    3964895853u,  655315400u, 2711298918u, 1791488195u, 2009251963u, 3164476382u,  973758832u, 4048990933u,
+      64357019u, 3364540734u, 1310630800u, 2235723829u, 2554806413u, 1394316072u, 3582976390u,  517157411u,
+    4018503926u,  618222419u, 2722963965u, 1762783832u, 1947517664u, 3209171269u,  970744811u, 4068520014u,
+     128714038u, 3438335635u, 1248109629u, 2167961496u, 2621261600u, 1466012805u, 3522553387u,  447296910u,
+    3959392091u,  547575038u, 2788632144u, 1835791861u, 1886307661u, 3140622056u, 1034314822u, 4143626211u,
+      75106221u, 3475428360u, 1236444838u, 2196665603u, 2682996155u, 1421317662u, 3525567664u,  427767573u,
+    3895035328u,  594892389u, 2782995659u, 1857943406u, 1941489622u, 3101955187u, 1047553757u, 4113347960u,
+     257428076u, 3288652233u, 1116777319u, 2311878850u, 2496219258u, 1603640287u, 3640781169u,  308099796u,
+    3809183745u,  676813732u, 2932025610u, 1704983215u, 2023410199u, 3016104370u,  894593820u, 4262377657u,
+     210634999u, 3352484690u, 1095150076u, 2316991065u, 2535410401u, 1547934020u, 3671583722u,  294336591u,
+    3772615322u,  729897279u, 2903845777u, 1716123700u, 2068629644u, 2953845545u,  914647431u, 4258839074u,
+     150212442u, 3282623743u, 1161604689u, 2388688372u, 2472889676u, 1480171241u, 3735940167u,  368132066u,
+    3836185911u,  805002898u, 2842635324u, 1647574937u, 2134298401u, 3026852996u,  855535146u, 4188192143u,
+     186781121u, 3229539940u, 1189784778u, 2377547631u, 2427670487u, 1542429810u, 3715886812u,  371670393u,
+    3882979244u,  741170185u, 2864262823u, 1642462466u, 2095107514u, 3082559007u,  824732849u, 4201955092u,
+     514856152u, 3589064573u, 1400419795u, 2552522358u, 2233554638u, 1316849003u, 3370776517u,   62202976u,
+    4075001525u,  968836368u, 3207280574u, 1954014235u, 1769133219u, 2720925446u,  616199592u, 4024870413u,
+     493229635u, 3594175974u, 1353627464u, 2616354029u, 2264355925u, 1303087088u, 3409966430u,    6498043u,
+    4046820398u,  979978123u, 3170710821u, 2007099008u, 1789187640u, 2717386141u,  661419827u, 3962610838u,
+     421269998u, 3527459403u, 1423225061u, 2676515648u, 2190300152u, 1238466653u, 3477467891u,   68755798u,
+    4115633027u, 1041448998u, 3095868040u, 1943789869u, 1860096405u, 2776760880u,  588673182u, 3897205563u,
+     449450869u, 3516317904u, 1459794558u, 2623431131u, 2170245475u, 1242006214u, 3432247400u,  131015629u,
+    4137259288u, 1036337853u, 3142660115u, 1879958454u, 1829294862u, 2790523051u,  549483013u, 3952910752u,
+     300424884u, 3669282065u, 1545650111u, 2541513754u, 2323209378u, 1092980487u, 3350330793u,  216870412u,
+    4256931033u,  921128828u, 2960342482u, 2066738807u, 1714085583u, 2910195050u,  736264132u, 3770592353u,
+     306060335u, 3647131530u, 1610005796u, 2494197377u, 2309971513u, 1123257756u, 3295149874u,  255536279u,
+    4268596802u,  892423655u, 3013951305u, 2029645036u, 1711070292u, 2929725425u,  674528607u, 3815288570u,
+     373562242u, 3709388839u, 1535949449u, 2429577516u, 2379569556u, 1183418929u, 3223189663u,  188820282u,
+    4195850735u,  827017802u, 3084859620u, 2089020225u, 1636228089u, 2866415708u,  743340786u, 3876759895u,
+     361896217u, 3738094268u, 1482340370u, 2466671543u, 2382584591u, 1163888810u, 3284924932u,  144124321u,
+    4190215028u,  849168593u, 3020503679u, 2136336858u, 1649465698u, 2836138695u,  798521449u, 3838094284u
+  },
+  {
+             0u, 2792819636u, 2543784233u,  837294749u, 4098827283u, 1379413927u, 1674589498u, 3316072078u,
+     871321191u, 2509784531u, 2758827854u,   34034938u, 3349178996u, 1641505216u, 1346337629u, 4131942633u,
+    1742642382u, 3249117050u, 4030828007u, 1446413907u, 2475800797u,  904311657u,   68069876u, 2725880384u,
+    1412551337u, 4064729373u, 3283010432u, 1708771380u, 2692675258u,  101317902u,  937551763u, 2442587175u,
+    3485284764u, 1774858792u, 1478633653u, 4266992385u, 1005723023u, 2642744891u, 2892827814u,  169477906u,
+    4233263099u, 1512406095u, 1808623314u, 3451546982u,  136139752u, 2926205020u, 2676114113u,  972376437u,
+    2825102674u,  236236518u, 1073525883u, 2576072655u, 1546420545u, 4200303349u, 3417542760u, 1841601500u,
+    2609703733u, 1039917185u,  202635804u, 2858742184u, 1875103526u, 3384067218u, 4166835727u, 1579931067u,
+    1141601657u, 3799809741u, 3549717584u, 1977839588u, 2957267306u,  372464350u,  668680259u, 2175552503u,
+    2011446046u, 3516084394u, 3766168119u, 1175200131u, 2209029901u,  635180217u,  338955812u, 2990736784u,
+     601221559u, 2242044419u, 3024812190u,  306049834u, 3617246628u, 1911408144u, 1074125965u, 3866285881u,
+     272279504u, 3058543716u, 2275784441u,  567459149u, 3832906691u, 1107462263u, 1944752874u, 3583875422u,
+    2343980261u,  767641425u,  472473036u, 3126744696u, 2147051766u, 3649987394u, 3899029983u, 1309766251u,
+    3092841090u,  506333494u,  801510315u, 2310084639u, 1276520081u, 3932237093u, 3683203000u, 2113813516u,
+    3966292011u, 1243601823u, 2079834370u, 3716205238u,  405271608u, 3192979340u, 2411259153u,  701492901u,
+    3750207052u, 2045810168u, 1209569125u, 4000285905u,  734575199u, 2378150379u, 3159862134u,  438345922u,
+    2283203314u,  778166598u,  529136603u, 3120492655u, 2086260449u, 3660498261u, 3955679176u, 1303499900u,
+    3153699989u,  495890209u,  744928700u, 2316418568u, 1337360518u, 3921775410u, 3626602927u, 2120129051u,
+    4022892092u, 1237286280u, 2018993941u, 3726666913u,  461853231u, 3186645403u, 2350400262u,  711936178u,
+    3693557851u, 2052076527u, 1270360434u, 3989775046u,  677911624u, 2384402428u, 3220639073u,  427820757u,
+    1202443118u, 3789347034u, 3493118535u, 1984154099u, 3018127229u,  362020041u,  612099668u, 2181885408u,
+    1950653705u, 3526596285u, 3822816288u, 1168934804u, 2148251930u,  645706414u,  395618355u, 2984485767u,
+     544559008u, 2248295444u, 3085590153u,  295523645u, 3560598451u, 1917673479u, 1134918298u, 3855773998u,
+     328860103u, 3052210803u, 2214924526u,  577903450u, 3889505748u, 1101147744u, 1883911421u, 3594338121u,
+    3424493451u, 1785369663u, 1535282850u, 4260726038u,  944946072u, 2653270060u, 2949491377u,  163225861u,
+    4294103532u, 1501944408u, 1752023237u, 3457862513u,  196998655u, 2915761739u, 2619532502u,  978710370u,
+    2881684293u,  229902577u, 1012666988u, 2586515928u, 1603020630u, 4193987810u, 3356702335u, 1852063179u,
+    2553040162u, 1046169238u,  263412747u, 2848217023u, 1818454321u, 3390333573u, 4227627032u, 1569420204u,
+      60859927u, 2782375331u, 2487203646u,  843627658u, 4159668740u, 1368951216u, 1617990445u, 3322386585u,
+     810543216u, 2520310724u, 2815490393u,   27783917u, 3288386659u, 1652017111u, 1402985802u, 4125677310u,
+    1685994201u, 3255382381u, 4091620336u, 1435902020u, 2419138250u,  910562686u,  128847843u, 2715354199u,
+    1469150398u, 4058414858u, 3222168983u, 1719234083u, 2749255853u,   94984985u,  876691844u, 2453031472u
+  },
+  {
+             0u, 3433693342u, 1109723005u, 2391738339u, 2219446010u, 1222643300u, 3329165703u,  180685081u,
+    3555007413u,  525277995u, 2445286600u, 1567235158u, 1471092047u, 2600801745u,  361370162u, 3642757804u,
+    2092642603u, 2953916853u, 1050555990u, 4063508168u, 4176560081u,  878395215u, 3134470316u, 1987983410u,
+    2942184094u, 1676945920u, 3984272867u,  567356797u,  722740324u, 3887998202u, 1764827929u, 2778407815u,
+    4185285206u,  903635656u, 3142804779u, 2012833205u, 2101111980u, 2979425330u, 1058630609u, 4088621903u,
+     714308067u, 3862526333u, 1756790430u, 2753330688u, 2933487385u, 1651734407u, 3975966820u,  542535930u,
+    2244825981u, 1231508451u, 3353891840u,  188896414u,   25648519u, 3442302233u, 1134713594u, 2399689316u,
+    1445480648u, 2592229462u,  336416693u, 3634843435u, 3529655858u,  516441772u, 2420588879u, 1559052753u,
+     698204909u, 3845636723u, 1807271312u, 2803025166u, 2916600855u, 1635634313u, 4025666410u,  593021940u,
+    4202223960u,  919787974u, 3093159461u, 1962401467u, 2117261218u, 2996361020u, 1008193759u, 4038971457u,
+    1428616134u, 2576151384u,  386135227u, 3685348389u, 3513580860u,  499580322u, 2471098945u, 1608776415u,
+    2260985971u, 1248454893u, 3303468814u,  139259792u,   42591881u, 3458459159u, 1085071860u, 2349261162u,
+    3505103035u,  474062885u, 2463016902u, 1583654744u, 1419882049u, 2550902495u,  377792828u, 3660491170u,
+      51297038u, 3483679632u, 1093385331u, 2374089965u, 2269427188u, 1273935210u, 3311514249u,  164344343u,
+    2890961296u, 1627033870u, 4000683757u,  585078387u,  672833386u, 3836780532u, 1782552599u, 2794821769u,
+    2142603813u, 3005188795u, 1032883544u, 4047146438u, 4227826911u,  928351297u, 3118105506u, 1970307900u,
+    1396409818u, 2677114180u,  287212199u, 3719594553u, 3614542624u,  467372990u, 2505346141u, 1509854403u,
+    2162073199u, 1282711281u, 3271268626u,  240228748u,   76845205u, 3359543307u, 1186043880u, 2317064054u,
+     796964081u, 3811226735u, 1839575948u, 2702160658u, 2882189835u, 1734392469u, 3924802934u,  625327592u,
+    4234522436u,  818917338u, 3191908409u, 1927981223u, 2016387518u, 3028656416u,  973776579u, 4137723485u,
+    2857232268u, 1726474002u, 3899187441u,  616751215u,  772270454u, 3803048424u, 1814228491u, 2693328533u,
+    2041117753u, 3036871847u,  999160644u, 4146592730u, 4259508931u,  826864221u, 3217552830u, 1936586016u,
+    3606501031u,  442291769u, 2496909786u, 1484378436u, 1388107869u, 2652297411u,  278519584u, 3694387134u,
+      85183762u, 3384397196u, 1194773103u, 2342308593u, 2170143720u, 1307820918u, 3279733909u,  265733131u,
+    2057717559u, 3054258089u,  948125770u, 4096344276u, 4276898253u,  843467091u, 3167309488u, 1885556270u,
+    2839764098u, 1709792284u, 3949353983u,  667704161u,  755585656u, 3785577190u, 1865176325u, 2743489947u,
+     102594076u, 3401021058u, 1144549729u, 2291298815u, 2186770662u, 1325234296u, 3228729243u,  215514885u,
+    3589828009u,  424832311u, 2547870420u, 1534552650u, 1370645331u, 2635621325u,  328688686u, 3745342640u,
+    2211456353u, 1333405183u, 3254067740u,  224338562u,  127544219u, 3408931589u, 1170156774u, 2299866232u,
+    1345666772u, 2627681866u,  303053225u, 3736746295u, 3565105198u,  416624816u, 2522494803u, 1525692365u,
+    4285207626u,  868291796u, 3176010551u, 1910772649u, 2065767088u, 3079346734u,  956571085u, 4121828691u,
+     747507711u, 3760459617u, 1856702594u, 2717976604u, 2831417605u, 1684930971u, 3940615800u,  642451174u
+  }
+};
+
+/*r is the CRC register, before the final inversion*/
+static unsigned crc32_slicing8(unsigned r, const unsigned char* data, size_t length)
+{
+  while(length >= 8)
+  {
+    unsigned lo = r ^ (data[0] | ((unsigned)data[1] << 8u) | ((unsigned)data[2] << 16u) | ((unsigned)data[3] << 24u));
+    unsigned hi = data[4] | ((unsigned)data[5] << 8u) | ((unsigned)data[6] << 16u) | ((unsigned)data[7] << 24u);
+    r = lodepng_crc32_slices[6][lo & 0xff] ^ lodepng_crc32_slices[5][(lo >> 8u) & 0xff]
+      ^ lodepng_crc32_slices[4][(lo >> 16u) & 0xff] ^ lodepng_crc32_slices[3][lo >> 24u]
+      ^ lodepng_crc32_slices[2][hi & 0xff] ^ lodepng_crc32_slices[1][(hi >> 8u) & 0xff]
+      ^ lodepng_crc32_slices[0][(hi >> 16u) & 0xff] ^ lodepng_crc32_table[hi >> 24u];
+    data += 8;
+    length -= 8;
+  }
+  while(length--) r = lodepng_crc32_table[(r ^ *data++) & 0xff] ^ (r >> 8);
+  return r;
+}
+
+#ifdef LODEPNG_SIMD_X86
+/*
+CRC of a multiple of 16 bytes, at least 64, by folding with carry-less multiplication,
+as in Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+The constants are powers of x modulo the bit-reflected polynomial, and the polynomial
+itself with its Barrett reduction constant. r is the CRC register before the final inversion
+*/
+static unsigned LODEPNG_TARGET("pclmul") crc32_PCLMUL(unsigned r, const unsigned char* data, size_t length)
+{
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596ll, 0x0154442bd4ll);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009ell, 0x01751997d0ll);
+  const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124ll);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641ll, 0x01db710641ll);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x1, x2, x3, x4, t1, t2, t3, t4;
+
+  x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(data + 0)), _mm_cvtsi32_si128((int)r));
+  x2 = _mm_loadu_si128((const __m128i*)(data + 16));
+  x3 = _mm_loadu_si128((const __m128i*)(data + 32));
+  x4 = _mm_loadu_si128((const __m128i*)(data + 48));
+  data += 64;
+  length -= 64;
+
+  /*fold 4 blocks of 16 bytes in parallel into the next 64 bytes*/
+  while(length >= 64)
+  {
+    t1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    t2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    t3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    t4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x11), t1);
+    x2 = _mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x11), t2);
+    x3 = _mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x11), t3);
+    x4 = _mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x11), t4);
+    x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)(data + 0)));
+    x2 = _mm_xor_si128(x2, _mm_loadu_si128((const __m128i*)(data + 16)));
+    x3 = _mm_xor_si128(x3, _mm_loadu_si128((const __m128i*)(data + 32)));
+    x4 = _mm_xor_si128(x4, _mm_loadu_si128((const __m128i*)(data + 48)));
+    data += 64;
+    length -= 64;
+  }
+
+  /*fold the 4 blocks into one, then the remaining blocks of 16 bytes into it*/
+  t1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), t1);
+  t1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), t1);
+  t1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), t1);
+  while(length >= 16)
+  {
+    t1 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), t1);
+    x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)data));
+    data += 16;
+    length -= 16;
+  }
+
+  /*fold 128 bits to 64*/
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00), x2);
+
+  /*Barrett reduction to 32 bits*/
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif /*LODEPNG_SIMD_X86*/
+
 /*Return the CRC of the bytes buf[0..len-1].*/
 unsigned lodepng_crc32(const unsigned char* data, size_t length)
 {
   unsigned r = 0xffffffffu;
-  size_t i;
-  for(i = 0; i < length; ++i)
+#ifdef LODEPNG_SIMD_X86
+  if(length >= 64 && (lodepng_cpu_features() & LODEPNG_CPU_PCLMUL))
   {
-    r = lodepng_crc32_table[(r ^ data[i]) & 0xff] ^ (r >> 8);
+    size_t folded = length & ~(size_t)15;
+    r = crc32_PCLMUL(r, data, folded);
+    data += folded;
+    length -= folded;
   }
+#endif /*LODEPNG_SIMD_X86*/
+  r = crc32_slicing8(r, data, length);
   return r ^ 0xffffffffu;
 }
 #else /* !LODEPNG_NO_COMPILE_CRC */
@@ -3972,8 +4843,8 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
   return state->error;
 }
 
-static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
-                                 size_t bytewidth, unsigned char filterType, size_t length)
+static unsigned unfilterScanlineScalar(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                       size_t bytewidth, unsigned char filterType, size_t length)
 {
   /*
   For PNG filter method 0
@@ -4046,6 +4917,216 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   return 0;
 }
 
+#ifdef LODEPNG_SIMD_X86
+/*loads the 3 or 4 bytes of a pixel in the low lanes*/
+static __m128i loadPixel_SSE2(const unsigned char* p, size_t bytewidth)
+{
+  int v;
+  if(bytewidth == 4) memcpy(&v, p, 4);
+  else v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return _mm_cvtsi32_si128(v);
+}
+
+static void storePixel_SSE2(unsigned char* p, __m128i pixel, size_t bytewidth)
+{
+  int v = _mm_cvtsi128_si32(pixel);
+  if(bytewidth == 4) memcpy(p, &v, 4);
+  else
+  {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+  }
+}
+
+static void unfilterUp_SSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                            size_t length)
+{
+  size_t i = 0;
+  for(; i + 16 <= length; i += 16)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i*)(scanline + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(precon + i));
+    _mm_storeu_si128((__m128i*)(recon + i), _mm_add_epi8(x, b));
+  }
+  for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+}
+
+static void LODEPNG_TARGET("avx2") unfilterUp_AVX2(unsigned char* recon, const unsigned char* scanline,
+                                                   const unsigned char* precon, size_t length)
+{
+  size_t i = 0;
+  for(; i + 32 <= length; i += 32)
+  {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(scanline + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(precon + i));
+    _mm256_storeu_si256((__m256i*)(recon + i), _mm256_add_epi8(x, b));
+  }
+  for(; i != length; ++i) recon[i] = scanline[i] + precon[i];
+}
+
+/*
+Sub, Average and Paeth of 3 or 4 bytes per pixel. Each pixel depends on the one
+before it, so the pixels are done in sequence, with the bytes of one in parallel.
+*/
+static void unfilterSub_SSE2(unsigned char* recon, const unsigned char* scanline, size_t bytewidth, size_t length)
+{
+  __m128i a = _mm_setzero_si128();
+  size_t i;
+  for(i = 0; i != length; i += bytewidth)
+  {
+    a = _mm_add_epi8(a, loadPixel_SSE2(&scanline[i], bytewidth));
+    storePixel_SSE2(&recon[i], a, bytewidth);
+  }
+}
+
+static void unfilterAverage_SSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                 size_t bytewidth, size_t length)
+{
+  const __m128i ones = _mm_set1_epi8(1);
+  __m128i a = _mm_setzero_si128();
+  size_t i;
+  for(i = 0; i != length; i += bytewidth)
+  {
+    __m128i b = loadPixel_SSE2(&precon[i], bytewidth);
+    /*_mm_avg_epu8 rounds up, the filter rounds down*/
+    __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), ones));
+    a = _mm_add_epi8(average, loadPixel_SSE2(&scanline[i], bytewidth));
+    storePixel_SSE2(&recon[i], a, bytewidth);
+  }
+}
+
+static __m128i abs16_SSE2(__m128i x)
+{
+  return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+/*mask ? x : y, for masks with all bits of a lane equal*/
+static __m128i select_SSE2(__m128i mask, __m128i x, __m128i y)
+{
+  return _mm_or_si128(_mm_and_si128(mask, x), _mm_andnot_si128(mask, y));
+}
+
+static void unfilterPaeth_SSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                               size_t bytewidth, size_t length)
+{
+  /*the left (a), up (b) and upper left (c) pixels, widened to 16 bits*/
+  const __m128i zero = _mm_setzero_si128();
+  __m128i a = zero, c = zero;
+  size_t i;
+  for(i = 0; i != length; i += bytewidth)
+  {
+    __m128i b = _mm_unpacklo_epi8(loadPixel_SSE2(&precon[i], bytewidth), zero);
+    /*same as paethPredictor: with p = a + b - c, pa = |p - a|, pb = |p - b|, pc = |p - c|*/
+    __m128i pa = _mm_sub_epi16(b, c);
+    __m128i pb = _mm_sub_epi16(a, c);
+    __m128i pc = abs16_SSE2(_mm_add_epi16(pa, pb));
+    __m128i smallest, predictor, x;
+    pa = abs16_SSE2(pa);
+    pb = abs16_SSE2(pb);
+    smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    predictor = select_SSE2(_mm_cmpeq_epi16(smallest, pa), a, select_SSE2(_mm_cmpeq_epi16(smallest, pb), b, c));
+    x = _mm_add_epi8(_mm_packus_epi16(predictor, predictor), loadPixel_SSE2(&scanline[i], bytewidth));
+    storePixel_SSE2(&recon[i], x, bytewidth);
+    a = _mm_unpacklo_epi8(x, zero);
+    c = b;
+  }
+}
+#endif /*LODEPNG_SIMD_X86*/
+
+/*
+Sub, Average and Paeth of 1 byte per pixel, as for palette images, can't be done in
+parallel. These versions keep the previous bytes in variables rather than reading
+them back from recon, which may alias scanline and so can't be kept in registers
+by the compiler.
+*/
+static void unfilterSub_1(unsigned char* recon, const unsigned char* scanline, size_t length)
+{
+  unsigned char a = 0;
+  size_t i;
+  for(i = 0; i != length; ++i)
+  {
+    a = (unsigned char)(scanline[i] + a);
+    recon[i] = a;
+  }
+}
+
+static void unfilterAverage_1(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                              size_t length)
+{
+  unsigned a = 0;
+  size_t i;
+  for(i = 0; i != length; ++i)
+  {
+    a = (unsigned char)(scanline[i] + ((a + precon[i]) >> 1));
+    recon[i] = (unsigned char)a;
+  }
+}
+
+static void unfilterPaeth_1(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                            size_t length)
+{
+  int a = 0, c = 0;
+  size_t i;
+  for(i = 0; i != length; ++i)
+  {
+    int b = precon[i];
+    int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - c - c);
+    /*same choice as paethPredictor, written so that it compiles to conditional moves*/
+    int predictor = pb < pa ? b : a;
+    int smallest = pb < pa ? pb : pa;
+    predictor = pc < smallest ? c : predictor;
+    a = (unsigned char)(scanline[i] + predictor);
+    recon[i] = (unsigned char)a;
+    c = b;
+  }
+}
+
+/*
+Faster versions of unfilterScanlineScalar for the common cases, using the
+instruction sets in features (see lodepng_cpu_features).
+Returns 1 if it unfiltered the scanline, or 0 to leave it to unfilterScanlineScalar.
+*/
+static unsigned unfilterScanlineFast(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                     size_t bytewidth, unsigned char filterType, size_t length, unsigned features)
+{
+  (void)features;
+  /*the first scanline of an image has no precon, which makes Up, Average and Paeth trivial*/
+  if(filterType < 1 || filterType > 4 || (!precon && filterType != 1)) return 0;
+  if(bytewidth == 1 && filterType != 2)
+  {
+    if(filterType == 1) unfilterSub_1(recon, scanline, length);
+    else if(filterType == 3) unfilterAverage_1(recon, scanline, precon, length);
+    else unfilterPaeth_1(recon, scanline, precon, length);
+    return 1;
+  }
+#ifdef LODEPNG_SIMD_X86
+  if(filterType == 2 && (features & LODEPNG_CPU_AVX2))
+  {
+    unfilterUp_AVX2(recon, scanline, precon, length);
+    return 1;
+  }
+  if(features & LODEPNG_CPU_SSE2)
+  {
+    if(filterType == 2) unfilterUp_SSE2(recon, scanline, precon, length);
+    else if(bytewidth != 3 && bytewidth != 4) return 0;
+    else if(filterType == 1) unfilterSub_SSE2(recon, scanline, bytewidth, length);
+    else if(filterType == 3) unfilterAverage_SSE2(recon, scanline, precon, bytewidth, length);
+    else unfilterPaeth_SSE2(recon, scanline, precon, bytewidth, length);
+    return 1;
+  }
+#endif /*LODEPNG_SIMD_X86*/
+  return 0;
+}
+
+/*unfilterScanlineScalar, with the fastest version the CPU supports*/
+static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                 size_t bytewidth, unsigned char filterType, size_t length)
+{
+  if(unfilterScanlineFast(recon, scanline, precon, bytewidth, filterType, length, lodepng_cpu_features())) return 0;
+  return unfilterScanlineScalar(recon, scanline, precon, bytewidth, filterType, length);
+}
+
 static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h, unsigned bpp)
 {
   /*
@@ -4385,7 +5466,7 @@ static unsigned readChunk_zTXt(LodePNGInfo* info, const LodePNGDecompressSetting
 
     length = (unsigned)chunkLength - string2_begin;
     /*will fail if zlib error, e.g. if length is too small*/
-    error = zlib_decompress(&decoded.data, &decoded.size,
+    error = zlib_decompress(&decoded.data, &decoded.size, 0,
                             (unsigned char*)(&data[string2_begin]),
                             length, zlibsettings);
     if(error) break;
@@ -4468,7 +5549,7 @@ static unsigned readChunk_iTXt(LodePNGInfo* info, const LodePNGDecompressSetting
     if(compressed)
     {
       /*will fail if zlib error, e.g. if length is too small*/
-      error = zlib_decompress(&decoded.data, &decoded.size,
+      error = zlib_decompress(&decoded.data, &decoded.size, 0,
                               (unsigned char*)(&data[begin]),
                               length, zlibsettings);
       if(error) break;
@@ -4524,19 +5605,12 @@ static unsigned readChunk_pHYs(LodePNGInfo* info, const unsigned char* data, siz
 }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize)
+/*read all chunks after the header, the data from the IDAT chunks is appended to idat*/
+static void readChunks(ucvector* idat, LodePNGState* state, const unsigned char* in, size_t insize)
 {
   unsigned char IEND = 0;
   const unsigned char* chunk;
   size_t i;
-  ucvector idat; /*the data from idat chunks*/
-  ucvector scanlines;
-  size_t predict;
-  size_t numpixels;
-  size_t outsize = 0;
 
   /*for unknown chunk order*/
   unsigned unknown = 0;
@@ -4544,21 +5618,6 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-  /*provide some proper output values if error will happen*/
-  *out = 0;
-
-  state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
-  if(state->error) return;
-
-  numpixels = *w * *h;
-
-  /*multiplication overflow*/
-  if(*h != 0 && numpixels / *h != *w) CERROR_RETURN(state->error, 92);
-  /*multiplication overflow possible further below. Allows up to 2^31-1 pixel
-  bytes with 16-bit RGBA, the rest is room for filter bytes.*/
-  if(numpixels > 268435455) CERROR_RETURN(state->error, 92);
-
-  ucvector_init(&idat);
   chunk = &in[33]; /*first byte of the first chunk after the header*/
 
   /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
@@ -4594,9 +5653,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     /*IDAT chunk, containing compressed image data*/
     if(lodepng_chunk_type_equals(chunk, "IDAT"))
     {
-      size_t oldsize = idat.size;
-      if(!ucvector_resize(&idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-      for(i = 0; i != chunkLength; ++i) idat.data[oldsize + i] = data[i];
+      size_t oldsize = idat->size;
+      if(!ucvector_resize(idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
+      for(i = 0; i != chunkLength; ++i) idat->data[oldsize + i] = data[i];
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4692,6 +5751,39 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
     if(!IEND) chunk = lodepng_chunk_next_const(chunk);
   }
+}
+
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+/*if dest is not NULL, the image is decoded into it and *out is set to dest, destsize must be at least
+the raw size of the image in the PNG's own color type. Otherwise *out is allocated.*/
+static void decodeGeneric(unsigned char** out, unsigned char* dest, size_t destsize,
+                          unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize)
+{
+  size_t i;
+  ucvector idat; /*the data from idat chunks*/
+  ucvector scanlines;
+  size_t predict;
+  size_t numpixels;
+  size_t outsize = 0;
+
+  /*provide some proper output values if error will happen*/
+  *out = 0;
+
+  state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
+  if(state->error) return;
+
+  numpixels = *w * *h;
+
+  /*multiplication overflow*/
+  if(*h != 0 && numpixels / *h != *w) CERROR_RETURN(state->error, 92);
+  /*multiplication overflow possible further below. Allows up to 2^31-1 pixel
+  bytes with 16-bit RGBA, the rest is room for filter bytes.*/
+  if(numpixels > 268435455) CERROR_RETURN(state->error, 92);
+
+  ucvector_init(&idat);
+  readChunks(&idat, state, in, insize);
 
   ucvector_init(&scanlines);
   /*predict output size, to allocate exact size for output buffer to avoid more dynamic allocation.
@@ -4714,10 +5806,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     if(*w > 1) predict += lodepng_get_raw_size_idat((*w + 0) >> 1, (*h + 1) >> 1, color) + ((*h + 1) >> 1);
     predict += lodepng_get_raw_size_idat((*w + 0), (*h + 0) >> 1, color) + ((*h + 0) >> 1);
   }
-  if(!state->error && !ucvector_reserve(&scanlines, predict)) state->error = 83; /*alloc fail*/
   if(!state->error)
   {
-    state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
+    state->error = zlib_decompress(&scanlines.data, &scanlines.size, predict, idat.data,
                                    idat.size, &state->decoder.zlibsettings);
     if(!state->error && scanlines.size != predict) state->error = 91; /*decompressed size doesn't match prediction*/
   }
@@ -4726,8 +5817,16 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   if(!state->error)
   {
     outsize = lodepng_get_raw_size(*w, *h, &state->info_png.color);
-    *out = (unsigned char*)lodepng_malloc(outsize);
-    if(!*out) state->error = 83; /*alloc fail*/
+    if(dest)
+    {
+      if(destsize < outsize) state->error = 97; /*output buffer too small*/
+      else *out = dest;
+    }
+    else
+    {
+      *out = (unsigned char*)lodepng_malloc(outsize);
+      if(!*out) state->error = 83; /*alloc fail*/
+    }
   }
   if(!state->error)
   {
@@ -4742,7 +5841,7 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         const unsigned char* in, size_t insize)
 {
   *out = 0;
-  decodeGeneric(out, w, h, state, in, insize);
+  decodeGeneric(out, 0, 0, w, h, state, in, insize);
   if(state->error) return state->error;
   if(!state->decoder.color_convert || lodepng_color_mode_equal(&state->info_raw, &state->info_png.color))
   {
@@ -4782,6 +5881,154 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
   return state->error;
 }
 
+unsigned lodepng_decode_into(unsigned char* out, size_t outsize, unsigned* w, unsigned* h,
+                             LodePNGState* state,
+                             const unsigned char* in, size_t insize)
+{
+  unsigned char* data = 0;
+  /*the header tells whether the scanlines can be unfiltered straight into out*/
+  state->error = lodepng_inspect(w, h, state, in, insize);
+  if(state->error) return state->error;
+  if(!state->decoder.color_convert || lodepng_color_mode_equal(&state->info_raw, &state->info_png.color))
+  {
+    decodeGeneric(&data, out, outsize, w, h, state, in, insize);
+    if(state->error) return state->error;
+    if(!state->decoder.color_convert)
+    {
+      state->error = lodepng_color_mode_copy(&state->info_raw, &state->info_png.color);
+    }
+    return state->error;
+  }
+
+  /*color conversion needed, decode into a temporary buffer and convert from there into out*/
+  if(!(state->info_raw.colortype == LCT_RGB || state->info_raw.colortype == LCT_RGBA)
+     && !(state->info_raw.bitdepth == 8))
+  {
+    return 56; /*unsupported color mode conversion*/
+  }
+  if(outsize < lodepng_get_raw_size(*w, *h, &state->info_raw)) CERROR_RETURN_ERROR(state->error, 97);
+
+  decodeGeneric(&data, 0, 0, w, h, state, in, insize);
+  if(!state->error)
+  {
+    state->error = lodepng_convert(out, data, &state->info_raw, &state->info_png.color, *w, *h);
+  }
+  lodepng_free(data);
+  return state->error;
+}
+
+/*the InflateSink context of lodepng_decode_bands, unfilters whole bands of scanlines*/
+typedef struct BandDecoder
+{
+  unsigned w, h;
+  unsigned bpp;
+  unsigned band_height;
+  unsigned y; /*first row of the next band*/
+  size_t linebytes; /*size of a scanline without the filter type byte, including padding bits*/
+  unsigned char* band; /*the unfiltered scanlines of the current band*/
+  unsigned char* prevline; /*the last unfiltered scanline of the previous band*/
+  LodePNGBandCallback callback;
+  void* context;
+} BandDecoder;
+
+static unsigned bandDecoder_flush(void* context, const unsigned char* data, size_t size, size_t* consumed)
+{
+  BandDecoder* decoder = (BandDecoder*)context;
+  /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
+  size_t bytewidth = (decoder->bpp + 7) / 8;
+  size_t linebytes = decoder->linebytes;
+
+  *consumed = 0;
+  while(decoder->y < decoder->h)
+  {
+    unsigned rows = decoder->h - decoder->y < decoder->band_height ? decoder->h - decoder->y : decoder->band_height;
+    size_t bandsize = (size_t)rows * (linebytes + 1);
+    unsigned r;
+    if(size - *consumed < bandsize) break;
+    for(r = 0; r != rows; ++r)
+    {
+      const unsigned char* scanline = &data[*consumed + r * (linebytes + 1)];
+      unsigned char* recon = &decoder->band[r * linebytes];
+      const unsigned char* precon = r != 0 ? recon - linebytes : decoder->y != 0 ? decoder->prevline : 0;
+      CERROR_TRY_RETURN(unfilterScanline(recon, &scanline[1], precon, bytewidth, scanline[0], linebytes));
+    }
+    /*the next band is unfiltered against the last scanline of this one, still with its padding bits*/
+    memcpy(decoder->prevline, &decoder->band[(rows - 1) * linebytes], linebytes);
+    if(decoder->bpp < 8 && (size_t)decoder->w * decoder->bpp != linebytes * 8)
+    {
+      size_t bits = (size_t)decoder->w * decoder->bpp * rows;
+      removePaddingBits(decoder->band, decoder->band, (size_t)decoder->w * decoder->bpp, linebytes * 8, rows);
+      /*clear the stale bits after the end of the band, like the zeroed buffer of lodepng_decode*/
+      if(bits & 7) decoder->band[bits / 8] &= (unsigned char)(0xFF << (8 - (bits & 7)));
+    }
+    CERROR_TRY_RETURN(decoder->callback(decoder->band, decoder->y, rows, decoder->context));
+    decoder->y += rows;
+    *consumed += bandsize;
+  }
+  return 0;
+}
+
+unsigned lodepng_decode_bands(unsigned* w, unsigned* h,
+                              LodePNGState* state,
+                              const unsigned char* in, size_t insize,
+                              unsigned band_height, LodePNGBandCallback callback, void* context)
+{
+  ucvector idat; /*the data from idat chunks*/
+  ucvector window; /*the inflated data that hasn't been unfiltered yet, or is still needed by back-references*/
+  BandDecoder decoder;
+  InflateSink sink;
+
+  state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
+  if(state->error) return state->error;
+  if(state->info_png.interlace_method != 0) CERROR_RETURN_ERROR(state->error, 95);
+  if(band_height == 0) CERROR_RETURN_ERROR(state->error, 96);
+
+  decoder.w = *w;
+  decoder.h = *h;
+  decoder.bpp = lodepng_get_bpp(&state->info_png.color);
+  decoder.band_height = band_height;
+  decoder.y = 0;
+  decoder.callback = callback;
+  decoder.context = context;
+  if(decoder.bpp == 0) CERROR_RETURN_ERROR(state->error, 31); /*error: invalid colortype*/
+  /*multiplication overflow*/
+  if(*w > ((size_t)(-1) - 7) / decoder.bpp) CERROR_RETURN_ERROR(state->error, 92);
+  decoder.linebytes = ((size_t)*w * decoder.bpp + 7) / 8;
+  if(decoder.linebytes + 1 > ((size_t)(-1) - INFLATE_WINDOW_SIZE - 65536 - 258) / band_height)
+  {
+    CERROR_RETURN_ERROR(state->error, 92);
+  }
+
+  ucvector_init(&idat);
+  ucvector_init(&window);
+  decoder.band = (unsigned char*)lodepng_malloc(band_height * decoder.linebytes);
+  decoder.prevline = (unsigned char*)lodepng_malloc(decoder.linebytes);
+  /*a whole band fits in front of the window each time the sink is flushed, so every flush consumes data.
+  The window buffer additionally fits the largest stored block or match that can overshoot the threshold*/
+  sink.flush = bandDecoder_flush;
+  sink.context = &decoder;
+  sink.threshold = band_height * (decoder.linebytes + 1) + INFLATE_WINDOW_SIZE;
+  if(!decoder.band || !decoder.prevline || !ucvector_reserve(&window, sink.threshold + 65536 + 258))
+  {
+    state->error = 83; /*alloc fail*/
+  }
+
+  if(!state->error) readChunks(&idat, state, in, insize);
+  /*the palette is only known after reading the chunks*/
+  if(!state->error) state->error = lodepng_color_mode_copy(&state->info_raw, &state->info_png.color);
+  if(!state->error)
+  {
+    state->error = zlib_decompressToSink(&window, &sink, idat.data, idat.size, &state->decoder.zlibsettings);
+    if(!state->error && decoder.y != *h) state->error = 91; /*decompressed size doesn't match prediction*/
+  }
+
+  ucvector_cleanup(&idat);
+  ucvector_cleanup(&window);
+  lodepng_free(decoder.band);
+  lodepng_free(decoder.prevline);
+  return state->error;
+}
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
                                size_t insize, LodePNGColorType colortype, unsigned bitdepth)
 {
@@ -6017,6 +7264,10 @@ const char* lodepng_error_text(unsigned code)
     case 92: return "too many pixels, not supported";
     case 93: return "zero width or height is invalid";
     case 94: return "header chunk must have a size of 13 bytes";
+    case 95: return "decoding in bands is not supported for interlaced images";
+    case 96: return "band height must not be zero";
+    case 97: return "output buffer is too small for the decoded image";
+    case 98: return "deflate range is not within the input";
   }
   return "unknown error code";
 }
@@ -6055,7 +7306,7 @@ unsigned decompress(std::vector<unsigned char>& out, const unsigned char* in, si
 {
   unsigned char* buffer = 0;
   size_t buffersize = 0;
-  unsigned error = zlib_decompress(&buffer, &buffersize, in, insize, &settings);
+  unsigned error = zlib_decompress(&buffer, &buffersize, 0, in, insize, &settings);
   if(buffer)
   {
     out.insert(out.end(), &buffer[0], &buffer[buffersize]);
@@ -6166,6 +7417,13 @@ unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
   return decode(out, w, h, state, in.empty() ? 0 : &in[0], in.size());
 }
 
+unsigned decode(unsigned char* out, size_t outsize, unsigned& w, unsigned& h,
+                State& state,
+                const unsigned char* in, size_t insize)
+{
+  return lodepng_decode_into(out, outsize, &w, &h, &state, in, insize);
+}
+
 #ifdef LODEPNG_COMPILE_DISK
 unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h, const std::string& filename,
                 LodePNGColorType colortype, unsigned bitdepth)
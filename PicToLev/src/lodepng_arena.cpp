@@ -0,0 +1,297 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#include "lodepng_arena.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+#include <lodepng.h>
+
+#ifdef LODEPNG_COMPILE_ALLOCATORS
+#error "lodepng.cpp must be built with LODEPNG_NO_COMPILE_ALLOCATORS to use the allocators defined here"
+#endif
+
+namespace {
+	// Precedes every block handed out to lodepng.
+	struct block_header {
+		// Arena the block belongs to, or nullptr for blocks allocated outside of any arena.
+		lodepng_arena* owner;
+		std::size_t size;
+		std::size_t capacity;
+		// Allocated on its own rather than from an arena chunk.
+		bool large;
+	};
+
+	constexpr std::size_t round_up(std::size_t size) noexcept {
+		constexpr std::size_t alignment = alignof(std::max_align_t);
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+	constexpr std::size_t header_size = round_up(sizeof(block_header));
+	constexpr std::size_t min_size_class = 4;
+
+	// Index of the free list for blocks of the given size, whose capacity is the next power of two.
+	std::size_t size_class(std::size_t size) noexcept {
+		std::size_t size_log2 = min_size_class;
+		while ((std::size_t {1} << size_log2) < size) {
+			size_log2++;
+		}
+		return size_log2 - min_size_class;
+	}
+
+	constexpr std::size_t class_capacity(std::size_t size_class) noexcept {
+		return std::size_t {1} << (size_class + min_size_class);
+	}
+
+	thread_local lodepng_arena* current_arena = nullptr;
+	std::atomic<std::size_t> heap_allocations {0};
+	std::atomic<std::size_t> arena_allocations {0};
+	std::atomic<std::size_t> frees {0};
+
+	block_header* header_of(void* pointer) noexcept {
+		return reinterpret_cast<block_header*>(static_cast<unsigned char*>(pointer) - header_size);
+	}
+
+	void* payload_of(block_header* block) noexcept {
+		return reinterpret_cast<unsigned char*>(block) + header_size;
+	}
+
+	block_header* allocate_block(lodepng_arena* owner, std::size_t size) noexcept {
+		void* memory = std::malloc(header_size + size);
+		if (!memory)
+			return nullptr;
+		heap_allocations.fetch_add(1, std::memory_order_relaxed);
+		return new (memory) block_header {owner, size, size, true};
+	}
+
+	block_header* reallocate_block(block_header* block, std::size_t size) noexcept {
+		void* memory = std::realloc(block, header_size + size);
+		if (!memory)
+			return nullptr;
+		heap_allocations.fetch_add(1, std::memory_order_relaxed);
+		block = static_cast<block_header*>(memory);
+		block->size = size;
+		block->capacity = size;
+		return block;
+	}
+}
+
+lodepng_arena::lodepng_arena(std::size_t chunk_size, std::size_t spare_limit) :
+	chunk_size(chunk_size),
+	spare_limit(spare_limit),
+	free_lists(size_class(chunk_size / 4) + 1, nullptr) {
+}
+
+lodepng_arena::~lodepng_arena() {
+	for (void* block : spares) {
+		std::free(block);
+	}
+}
+
+void lodepng_arena::reset() noexcept {
+	current_chunk = 0;
+	current_offset = 0;
+	top = nullptr;
+	std::fill(free_lists.begin(), free_lists.end(), nullptr);
+}
+
+void* lodepng_arena::allocate(std::size_t size) noexcept {
+	if (size > chunk_size / 4)
+		return allocate_large(size);
+	return allocate_small(size);
+}
+
+void* lodepng_arena::allocate_large(std::size_t size) noexcept {
+	// Reuse the smallest spare block that fits without wasting more than half of it.
+	const auto fits = [size](const void* block) {
+		const std::size_t capacity = static_cast<const block_header*>(block)->capacity;
+		return capacity >= size && capacity / 2 <= size;
+	};
+	const auto best = std::min_element(spares.begin(), spares.end(), [&fits](const void* a, const void* b) {
+		return fits(a) != fits(b) ? fits(a) : static_cast<const block_header*>(a)->capacity < static_cast<const block_header*>(b)->capacity;
+	});
+	if (best != spares.end() && fits(*best)) {
+		block_header* block = static_cast<block_header*>(*best);
+		spares.erase(best);
+		spare_size -= block->capacity;
+		block->size = size;
+		arena_allocations.fetch_add(1, std::memory_order_relaxed);
+		return payload_of(block);
+	}
+	block_header* block = allocate_block(this, size);
+	return block ? payload_of(block) : nullptr;
+}
+
+void* lodepng_arena::allocate_small(std::size_t size) noexcept {
+	const std::size_t index = size_class(size);
+	if (void* reused = free_lists[index]) {
+		std::memcpy(&free_lists[index], reused, sizeof(void*));
+		header_of(reused)->size = size;
+		arena_allocations.fetch_add(1, std::memory_order_relaxed);
+		return reused;
+	}
+	const std::size_t capacity = class_capacity(index);
+	const std::size_t needed = header_size + capacity;
+	while (current_chunk < chunks.size() && current_offset + needed > chunks[current_chunk].size) {
+		current_chunk++;
+		current_offset = 0;
+	}
+	if (current_chunk == chunks.size()) {
+		chunk added {std::unique_ptr<unsigned char[]>(new (std::nothrow) unsigned char[chunk_size]), chunk_size};
+		if (!added.data)
+			return nullptr;
+		try {
+			chunks.push_back(std::move(added));
+		} catch (const std::bad_alloc&) {
+			return nullptr;
+		}
+		heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	}
+	block_header* block = new (chunks[current_chunk].data.get() + current_offset) block_header {this, size, capacity, false};
+	current_offset += needed;
+	top = payload_of(block);
+	arena_allocations.fetch_add(1, std::memory_order_relaxed);
+	return top;
+}
+
+void* lodepng_arena::reallocate(void* pointer, std::size_t size) noexcept {
+	block_header* block = header_of(pointer);
+	if (size <= block->capacity) {
+		block->size = size;
+		arena_allocations.fetch_add(1, std::memory_order_relaxed);
+		return pointer;
+	}
+	if (pointer == top) {
+		// The last small allocation can grow in place while its chunk has room.
+		const std::size_t offset = static_cast<std::size_t>(reinterpret_cast<unsigned char*>(block) - chunks[current_chunk].data.get());
+		const std::size_t capacity = class_capacity(size_class(size));
+		if (size <= chunk_size / 4 && offset + header_size + capacity <= chunks[current_chunk].size) {
+			block->size = size;
+			block->capacity = capacity;
+			current_offset = offset + header_size + block->capacity;
+			arena_allocations.fetch_add(1, std::memory_order_relaxed);
+			return pointer;
+		}
+	}
+	if (block->large && size > chunk_size / 4) {
+		block = reallocate_block(block, size);
+		return block ? payload_of(block) : nullptr;
+	}
+	void* moved = allocate(size);
+	if (!moved)
+		return nullptr;
+	std::memcpy(moved, pointer, block->size);
+	release(pointer);
+	return moved;
+}
+
+void lodepng_arena::release(void* pointer) noexcept {
+	block_header* block = header_of(pointer);
+	if (!block->large) {
+		if (pointer == top) {
+			current_offset = static_cast<std::size_t>(reinterpret_cast<unsigned char*>(block) - chunks[current_chunk].data.get());
+			top = nullptr;
+		} else {
+			const std::size_t index = size_class(block->capacity);
+			std::memcpy(pointer, &free_lists[index], sizeof(void*));
+			free_lists[index] = pointer;
+		}
+		return;
+	}
+	if (spare_size + block->capacity <= spare_limit) {
+		try {
+			spares.push_back(block);
+			spare_size += block->capacity;
+			return;
+		} catch (const std::bad_alloc&) {
+		}
+	}
+	std::free(block);
+}
+
+lodepng_arena_scope::lodepng_arena_scope(lodepng_arena& arena) noexcept :
+	previous(current_arena) {
+	current_arena = &arena;
+}
+
+lodepng_arena_scope::~lodepng_arena_scope() {
+	current_arena = previous;
+}
+
+lodepng_allocation_stats get_lodepng_allocation_stats() noexcept {
+	return {
+		heap_allocations.load(std::memory_order_relaxed),
+		arena_allocations.load(std::memory_order_relaxed),
+		frees.load(std::memory_order_relaxed),
+	};
+}
+
+// The allocation hooks declared by lodepng.cpp when built with LODEPNG_NO_COMPILE_ALLOCATORS.
+
+void* lodepng_malloc(std::size_t size) {
+	if (current_arena)
+		return current_arena->allocate(size);
+	block_header* block = allocate_block(nullptr, size);
+	return block ? payload_of(block) : nullptr;
+}
+
+void lodepng_free(void* pointer) {
+	if (!pointer)
+		return;
+	frees.fetch_add(1, std::memory_order_relaxed);
+	block_header* block = header_of(pointer);
+	if (!block->owner) {
+		std::free(block);
+	} else if (block->owner == current_arena) {
+		current_arena->release(pointer);
+	} else if (block->large) {
+		// Other arenas may be in use by other threads, so only their large blocks, which they don't keep track of
+		// while allocated, can be returned. The rest is reclaimed when the arena is reset.
+		std::free(block);
+	}
+}
+
+void* lodepng_realloc(void* pointer, std::size_t new_size) {
+	if (!pointer)
+		return lodepng_malloc(new_size);
+	block_header* block = header_of(pointer);
+	if (!block->owner) {
+		block = reallocate_block(block, new_size);
+		return block ? payload_of(block) : nullptr;
+	}
+	if (block->owner == current_arena)
+		return current_arena->reallocate(pointer, new_size);
+	// Arena memory used outside of the scope of its arena; move it to where this thread allocates.
+	void* moved = lodepng_malloc(new_size);
+	if (!moved)
+		return nullptr;
+	std::memcpy(moved, pointer, std::min(block->size, new_size));
+	lodepng_free(pointer);
+	return moved;
+}
@@ -23,21 +23,44 @@
 ////////////////////////////////////////////////////////////
 
 #include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
-#include <map>
+#include <limits>
+#include <new>
+#include <numeric>
+#include <optional>
+#include <ostream>
+#include <sstream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
 #include <utility>
 #include <vector>
+#include <gsl/gsl_assert>
 #include <gsl/gsl_util>
 #include <gsl/span>
 #include <lodepng.h>
+#include "band_queue.h"
 #include "binary_serialization.h"
+#include "compression_level.h"
 #include "container_hash.h"
+#include "grid.h"
 #include "grid_size.h"
+#include "lodepng_arena.h"
+#include "mapped_file.h"
+#include "parallel_deflate.h"
+#include "tile_dictionary.h"
+#include "tile_flips.h"
 #include "tiles.h"
 
 constexpr unsigned image_count = 2;
@@ -47,174 +70,870 @@ constexpr unsigned max_tiles = 4090;
 constexpr unsigned tileset_width = 10;
 constexpr unsigned tileset_image_width = tileset_width * tileset_tile_size;
 constexpr unsigned word_size = 4;
+// Bits of a layer entry that mirror the tile; the vertical one is a JJ2+ extension.
+constexpr unsigned horizontal_flip_flag = 0x1000;
+constexpr unsigned vertical_flip_flag = 0x2000;
+constexpr std::size_t stream_queue_capacity = 2;
+// Tiles deduplicated in parallel between checks of the tileset budget.
+constexpr std::size_t dedup_chunk_tiles = 1 << 15;
+// Returned from the band callback when the consumer has stopped; outside of lodepng's error range.
+constexpr unsigned stream_aborted = 1000;
+
+using image_t = tile_view<const unsigned char, tileset_tile_size>;
+using tile_t = std::array<image_t, image_count>;
+// Tiles of one colour with a uniform mask are told apart by the colour and the
+// mask bit alone, and skip the dictionary.
+constexpr std::size_t uniform_tile_kinds = 2 << std::numeric_limits<unsigned char>::digits;
+constexpr std::uint16_t empty_tile_kind = 0;
+constexpr std::uint16_t general_tile_kind = uniform_tile_kinds;
+constexpr unsigned no_uniform_tile_id = std::numeric_limits<unsigned>::max();
+using tile_key = oriented_tile<tile_t>;
+using tile_dictionary_t = tile_dictionary<tile_key, oriented_tile_hash, oriented_tile_equal>;
+
+struct program_options {
+	bool stream = false;
+	bool alloc_stats = false;
+	bool dictionary_stats = false;
+	bool timing = false;
+	bool repack = false;
+	bool flip = false;
+	// Keeps counting distinct tiles past the budget, for the overflow report.
+	bool count_overflow = false;
+	// Zero stands for the number of hardware threads.
+	unsigned threads = 0;
+	compression_level compression = compression_level::normal;
+	std::vector<std::string> filenames;
+};
 
 template<class T>
 struct image_file_context {
 	std::string filename;
+	mapped_file file;
 	std::vector<unsigned char> buffer;
-	bool known_size;
 	grid_size size;
+	// Serves lodepng's allocations while decoding; must outlive the state, which may own some of them.
+	lodepng_arena arena;
 	lodepng::State state;
-	tile_vector<T> tiles;
-	typename tile_vector<T>::iterator tiles_it;
+	tile_vector<T, tileset_tile_size> tiles;
+	typename tile_vector<T, tileset_tile_size>::iterator tiles_it;
 };
 
-bool get_tile_list(image_file_context<const unsigned char>& context) {
-	std::vector<unsigned char> file_buffer;
-	unsigned error = lodepng::load_file(file_buffer, context.filename);
-	if (error != 0) {
+bool parse_arguments(gsl::span<char*> arguments, program_options& options) {
+	for (const char* argument : arguments.subspan(1)) {
+		const std::string_view view(argument);
+		if (view.substr(0, 2) != "--") {
+			options.filenames.emplace_back(view);
+		} else if (view == "--stream") {
+			options.stream = true;
+		} else if (view == "--alloc-stats") {
+			options.alloc_stats = true;
+		} else if (view == "--dictionary-stats") {
+			options.dictionary_stats = true;
+		} else if (view == "--timing") {
+			options.timing = true;
+		} else if (view == "--repack") {
+			options.repack = true;
+		} else if (view == "--flip") {
+			options.flip = true;
+		} else if (view == "--count-overflow") {
+			options.count_overflow = true;
+		} else if (view.substr(0, 10) == "--threads=") {
+			const std::string_view value = view.substr(10);
+			const auto result = std::from_chars(value.data(), value.data() + value.size(), options.threads);
+			if (result.ec != std::errc() || result.ptr != value.data() + value.size()) {
+				std::cerr << "Invalid thread count " << value << std::endl;
+				return false;
+			}
+		} else if (view.substr(0, 8) == "--level=") {
+			const std::string_view value = view.substr(8);
+			const auto it = std::find_if(compression_level_names.begin(), compression_level_names.end(),
+				[value](const auto& entry) { return entry.first == value; });
+			if (it == compression_level_names.end()) {
+				std::cerr << "Invalid compression level " << value << std::endl;
+				return false;
+			}
+			options.compression = it->second;
+		} else {
+			std::cerr << "Unknown option " << view << std::endl;
+			return false;
+		}
+	}
+	if (options.filenames.size() != image_count) {
+		std::cerr << "PicToLev expects exactly " << image_count << " arguments" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool open_image(image_file_context<const unsigned char>& context) {
+	if (const std::error_code error = context.file.open(context.filename)) {
 		std::cerr << "An error has occurred when loading file ";
 		std::cerr << context.filename << ":\n";
-		std::cerr << lodepng_error_text(error) << std::endl;
+		std::cerr << error.message() << std::endl;
 		return false;
 	}
+	const auto file_data = context.file.data();
 	unsigned width;
 	unsigned height;
-	error = lodepng::decode(context.buffer, width, height, context.state, file_buffer);
+	const unsigned error = lodepng_inspect(&width, &height, &context.state, file_data.data(), file_data.size());
 	if (error != 0) {
 		std::cerr << "An error has occurred when decoding file ";
 		std::cerr << context.filename << ":\n";
 		std::cerr << lodepng_error_text(error) << std::endl;
 		return false;
 	}
-	if (context.known_size) {
-		if (width != context.size.width || height != context.size.height) {
-			std::cerr << "File " << context.filename << " has incorrect image size\n";
-			std::cerr << "Sizes of all images must be equal" << std::endl;
-			return false;
-		}
-	} else {
-		context.size.width = width;
-		context.size.height = height;
-	}
+	context.size.width = width;
+	context.size.height = height;
 	if (width & 31 || height & 31) {
 		std::cerr << "File " << context.filename << " has incorrect image size\n";
 		std::cerr << "Width and height must be multiples of 32" << std::endl;
 		return false;
 	}
-	const auto image = buffer_to_image(gsl::make_span(std::as_const(context.buffer)), context.size);
-	context.tiles = image_to_tile_list(image.begin(), image.end(), tileset_tile_size);
 	return true;
 }
 
-// TODO: This is an invariant and should be a class.
-// A generic grid template would be preferable.
+void mask_to_binary(std::vector<unsigned char>& buffer) {
+	for (auto&& index : buffer) {
+		index = index != 0;
+	}
+}
+
+// Splits the decoded part of the image in the buffer into tiles, optionally
+// repacking it first so that every tile is contiguous in memory.
+void make_tile_list(image_file_context<const unsigned char>& context, grid_size size, bool repack) {
+	if (!repack) {
+		context.tiles = buffer_to_tile_list<tileset_tile_size>(gsl::make_span(std::as_const(context.buffer)), size);
+		return;
+	}
+	// The row-major image is released on return, so only one full copy outlives the repack.
+	std::vector<unsigned char> packed(context.buffer.size());
+	repack_tiles<tileset_tile_size>(gsl::make_span(std::as_const(context.buffer)), size, gsl::make_span(packed));
+	context.buffer.swap(packed);
+	context.tiles = packed_buffer_to_tile_list<tileset_tile_size>(gsl::make_span(std::as_const(context.buffer)));
+}
+
+bool get_tile_list(image_file_context<const unsigned char>& context, bool repack, std::ostream& log) {
+	const lodepng_arena_scope arena_scope(context.arena);
+	const auto file_data = context.file.data();
+	unsigned width;
+	unsigned height;
+	// The header was already read by open_image, so the image can be decoded straight into the buffer.
+	context.buffer.resize(lodepng_get_raw_size(gsl::narrow_cast<unsigned>(context.size.width), gsl::narrow_cast<unsigned>(context.size.height), &context.state.info_png.color));
+	const unsigned error = lodepng::decode(context.buffer.data(), context.buffer.size(), width, height, context.state, file_data.data(), file_data.size());
+	context.file.close();
+	if (error != 0) {
+		log << "An error has occurred when decoding file ";
+		log << context.filename << ":\n";
+		log << lodepng_error_text(error) << std::endl;
+		return false;
+	}
+	make_tile_list(context, context.size, repack);
+	return true;
+}
+
+struct band_producer {
+	band_queue& bands;
+	const LodePNGColorMode& color;
+	unsigned width;
+};
+
+unsigned push_band(const unsigned char* band, unsigned, unsigned rows, void* context) try {
+	const auto& producer = *static_cast<const band_producer*>(context);
+	const std::size_t size = lodepng_get_raw_size(producer.width, rows, &producer.color);
+	return producer.bands.push(band_queue::band_type(band, band + size)) ? 0 : stream_aborted;
+} catch (const std::bad_alloc&) {
+	return 83;
+}
+
+// Decodes the image in bands of one tile row each and hands them over to the
+// consumer through the queue, so that the whole image is never in memory.
+bool stream_tile_bands(image_file_context<const unsigned char>& context, band_queue& bands, std::ostream& log) {
+	const auto close_queue = gsl::finally([&bands]() { bands.close(); });
+	const lodepng_arena_scope arena_scope(context.arena);
+	const auto file_data = context.file.data();
+	band_producer producer {bands, context.state.info_png.color, gsl::narrow_cast<unsigned>(context.size.width)};
+	unsigned width;
+	unsigned height;
+	const unsigned error = lodepng_decode_bands(&width, &height, &context.state, file_data.data(), file_data.size(),
+		tileset_tile_size, push_band, &producer);
+	context.file.close();
+	if (error != 0 && error != stream_aborted) {
+		log << "An error has occurred when decoding file ";
+		log << context.filename << ":\n";
+		log << lodepng_error_text(error) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool next_tile_band(image_file_context<const unsigned char>& context, band_queue& bands, bool repack) {
+	auto band = bands.pop();
+	if (!band)
+		return false;
+	context.buffer = std::move(*band);
+	make_tile_list(context, {context.size.width, tileset_tile_size}, repack);
+	context.tiles_it = context.tiles.begin();
+	return true;
+}
+
+using output_contexts = image_file_context<unsigned char>[image_count];
+
+// Sets up the output images with the first tileset row, which starts with the
+// empty tile. They then grow a tileset row at a time as store_tile fills them,
+// within capacity for one tile over the budget, so they never reallocate.
+void init_tileset_images(output_contexts& outputs) {
+	for (auto&& output : outputs) {
+		output.buffer.reserve(grid_area({tileset_image_width, (max_tiles / tileset_width + 1) * tileset_tile_size}));
+		output.buffer.assign(grid_area({tileset_image_width, tileset_tile_size}), 0);
+	}
+}
+
+// Copies the tile into its slot in the output images, which also makes it
+// outlive the input image bands, and returns the key of the copy.
+tile_key store_tile(output_contexts& outputs, const tile_key& key, std::size_t id) {
+	constexpr std::size_t tileset_row_size = grid_area({tileset_image_width, tileset_tile_size});
+	const std::size_t offset = id / tileset_width * tileset_row_size + id % tileset_width * tileset_tile_size;
+	tile_key stored {{}, key.flip};
+	for (gsl::index i = 0; i < image_count; i++) {
+		auto& buffer = gsl::at(outputs, i).buffer;
+		if (offset >= buffer.size()) {
+			Expects(buffer.size() + tileset_row_size <= buffer.capacity());
+			buffer.resize(buffer.size() + tileset_row_size);
+		}
+		unsigned char* out = buffer.data() + offset;
+		for (const auto& row : gsl::at(key.tile, i)) {
+			std::copy(row.data(), row.data() + row.size(), out);
+			out += tileset_image_width;
+		}
+		gsl::at(stored.tile, i) = image_t(buffer.data() + offset, tileset_image_width);
+	}
+	return stored;
+}
+
+// Keeps a tile that already outlives the dictionary as it is.
+tile_key keep_tile(const tile_key& key, std::size_t) {
+	return key;
+}
+
+// Measures consecutive stages of the conversion for --timing.
+class stage_clock {
+public:
+	// Milliseconds since the previous call, or since construction.
+	double lap() noexcept {
+		const auto now = std::chrono::steady_clock::now();
+		const std::chrono::duration<double, std::milli> elapsed = now - last;
+		last = now;
+		return elapsed.count();
+	}
+private:
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+};
+
+// How many tiles each path of the deduplication resolved.
+struct tile_path_stats {
+	std::size_t empty = 0;
+	std::size_t uniform = 0;
+	std::size_t hashed = 0;
+	void count(std::uint16_t kind) noexcept {
+		(kind == empty_tile_kind ? empty : kind == general_tile_kind ? hashed : uniform)++;
+	}
+	tile_path_stats& operator+=(const tile_path_stats& other) noexcept {
+		empty += other.empty;
+		uniform += other.uniform;
+		hashed += other.hashed;
+		return *this;
+	}
+};
+
+// IDs of the uniform tiles found so far, by kind.
+struct uniform_tile_ids {
+	uniform_tile_ids() noexcept {
+		ids.fill(no_uniform_tile_id);
+		// The dictionary always starts with the empty tile.
+		ids[empty_tile_kind] = 0;
+	}
+	std::array<unsigned, uniform_tile_kinds> ids;
+};
+
+// The colour and mask bit of a uniform tile, or general_tile_kind. Needs a binary mask.
+std::uint16_t classify_tile(const tile_t& tile) {
+	unsigned char colour;
+	unsigned char mask;
+	if (!is_uniform(tile[0], colour) || !is_uniform(tile[1], mask))
+		return general_tile_kind;
+	return gsl::narrow_cast<std::uint16_t>(colour | mask << std::numeric_limits<unsigned char>::digits);
+}
+
+tile_key make_tile_key(const tile_t& tile, bool flip) {
+	return {tile, flip ? canonical_flip(tile) : no_flip};
+}
+
+// The layer entry of a tile that is the mirror image by flip of the tile with the given ID.
+std::uint16_t layer_entry(tile_dictionary_t::id_type id, unsigned flip) {
+	return gsl::narrow_cast<std::uint16_t>(id | (flip & horizontal_flip ? horizontal_flip_flag : 0) | (flip & vertical_flip ? vertical_flip_flag : 0));
+}
+
+// Adds the tile to the dictionary and returns its layer entry.
+template<class Store>
+std::uint16_t emplace_tile(tile_dictionary_t& tiles, const tile_key& key, Store&& store) {
+	const auto id = tiles.emplace(key, std::forward<Store>(store)).first;
+	return layer_entry(id, tiles.values()[id].flip ^ key.flip);
+}
+
+// Adds the tile to the dictionary unless it is uniform and returns its layer
+// entry. Uniform tiles are symmetric, so their entries never have flip bits.
+template<class Store>
+std::uint16_t resolve_tile(tile_dictionary_t& tiles, uniform_tile_ids& uniform_ids, const tile_t& tile, bool flip, Store&& store, tile_path_stats& stats) {
+	const std::uint16_t kind = classify_tile(tile);
+	stats.count(kind);
+	if (kind == general_tile_kind)
+		return emplace_tile(tiles, make_tile_key(tile, flip), std::forward<Store>(store));
+	auto& id = uniform_ids.ids[kind];
+	if (id == no_uniform_tile_id) {
+		id = tiles.emplace({tile, no_flip}, std::forward<Store>(store)).first;
+	}
+	return gsl::narrow_cast<std::uint16_t>(id);
+}
+
 struct level_file_context {
+	// Rows are padded to whole words with empty tiles.
+	grid<std::uint16_t> layer;
+};
+
+// Runs task(0) to task(count - 1) on separate threads and waits for all of them.
+template<class Task>
+void run_parallel(std::size_t count, const Task& task) {
+	std::vector<std::future<void>> results;
+	for (std::size_t i = 1; i < count; i++) {
+		results.push_back(std::async(std::launch::async, std::cref(task), i));
+	}
+	task(0);
+	for (auto&& result : results) {
+		result.get();
+	}
+}
+
+// Packs word_size 16-bit layer entries into one key, the first entry in the lowest bits.
+std::uint64_t pack_word(const std::uint16_t* entries) {
+	std::uint64_t word = 0;
+	for (unsigned i = 0; i != word_size; i++) {
+		word |= std::uint64_t(entries[i]) << (i * 16);
+	}
+	return word;
+}
+
+// Packed words are their own fingerprints; the dictionary spreads their bits over its slots.
+struct packed_word_hash {
+	std::uint64_t operator()(std::uint64_t word) const noexcept {
+		return word;
+	}
+};
+
+using word_dictionary_t = tile_dictionary<std::uint64_t, packed_word_hash>;
+// Stream4 refers to words by 16-bit IDs, which include the empty word.
+constexpr std::size_t max_words = word_dictionary_t::max_size;
+
+// The distinct words of a level, starting with the empty word, and the ID of
+// every word of its layer.
+struct level_words {
+	std::vector<std::uint64_t> dictionary;
+	std::vector<word_dictionary_t::id_type> words;
+};
+
+// Builds the word dictionary with thread_count threads. The words are first
+// deduplicated within row bands, and the distinct words of every band are then
+// added to the dictionary in band order and in order of first occurrence within
+// the band, which numbers them like a single row-major pass would. Throws
+// tile_dictionary_full if the level has more than max_words distinct words.
+level_words make_level_words(const level_file_context& context, unsigned thread_count) {
+	const std::size_t reduced_width = context.layer.stride() / word_size;
+	const std::size_t height = context.layer.size().height;
+	const auto entries = context.layer.elements();
+	const std::size_t band_count = std::max<std::size_t>(std::min<std::size_t>(thread_count, height), 1);
+	const auto band_first_row = [&](std::size_t band) { return band * height / band_count; };
+	std::vector<word_dictionary_t::id_type> words(height * reduced_width);
+	const auto keep = [](std::uint64_t word, std::size_t) { return word; };
+	std::vector<word_dictionary_t> band_dictionaries;
+	band_dictionaries.reserve(band_count);
+	for (std::size_t band = 0; band != band_count; band++) {
+		band_dictionaries.emplace_back((band_first_row(band + 1) - band_first_row(band)) * reduced_width);
+	}
+	run_parallel(band_count, [&](std::size_t band) {
+		auto& band_dictionary = band_dictionaries[band];
+		for (std::size_t word = band_first_row(band) * reduced_width; word != band_first_row(band + 1) * reduced_width; word++) {
+			words[word] = band_dictionary.emplace(pack_word(entries.data() + word * word_size), keep).first;
+		}
+	});
+	word_dictionary_t word_dictionary(words.size() + 1);
+	word_dictionary.emplace(0, keep);
+	// The dictionary ID of every word of every band, by ID in the band.
+	std::vector<std::vector<word_dictionary_t::id_type>> band_ids(band_count);
+	for (std::size_t band = 0; band != band_count; band++) {
+		for (const std::uint64_t word : band_dictionaries[band].values()) {
+			band_ids[band].push_back(word_dictionary.emplace(word, keep).first);
+		}
+	}
+	run_parallel(band_count, [&](std::size_t band) {
+		const auto& ids = band_ids[band];
+		const auto first = words.begin() + band_first_row(band) * reduced_width;
+		const auto last = words.begin() + band_first_row(band + 1) * reduced_width;
+		for (auto word_it = first; word_it != last; ++word_it) {
+			*word_it = ids[*word_it];
+		}
+	});
+	return {word_dictionary.values(), std::move(words)};
+}
+
+// Writes the word dictionary to Stream3 and the words of the layer to Stream4.
+// Returns false, without writing the streams, if the level has more than
+// max_words distinct words.
+bool write_data_streams(const level_file_context& context, unsigned thread_count) try {
+	const level_words words = make_level_words(context, thread_count);
+	// A packed word in little-endian order is its 16-bit entries in little-endian order.
+	std::ofstream stream3("Stream3", std::ios::binary);
+	write_binary<endian::little>(stream3, gsl::make_span(words.dictionary));
+	std::ofstream stream4("Stream4", std::ios::binary);
+	write_binary<endian::little>(stream4, gsl::make_span(words.words));
+	return true;
+} catch (const tile_dictionary_full&) {
+	std::cerr << "The level would have more than ";
+	std::cerr << max_words << " distinct words" << std::endl;
+	return false;
+}
+
+using input_contexts = image_file_context<const unsigned char>[image_count];
+
+tile_t get_tile(const input_contexts& inputs, gsl::index index) {
+	tile_t tile;
+	for (gsl::index i = 0; i < image_count; i++) {
+		gsl::at(tile, i) = gsl::at(gsl::at(inputs, i).tiles, index);
+	}
+	return tile;
+}
+
+// Counts the distinct tiles that every row of the layer introduces, and finds
+// the tile that takes the tileset over max_tiles. Distinct tiles must be added
+// in order of first occurrence.
+struct tile_budget_report {
+	explicit tile_budget_report(grid_size layer_size) : layer_size(layer_size), new_tiles(layer_size.height) {}
+	void add(std::size_t index) {
+		new_tiles[index / layer_size.width]++;
+		if (distinct_tiles++ == max_tiles) {
+			overflow_index = index;
+		}
+	}
+	bool exceeded() const noexcept {
+		return distinct_tiles > max_tiles;
+	}
 	grid_size layer_size;
-	std::vector<std::vector<unsigned>> layer;
+	std::vector<std::size_t> new_tiles;
+	// Starts with the empty tile, which every tileset has.
+	std::size_t distinct_tiles = 1;
+	std::size_t overflow_index = 0;
+	// Whether the whole layer was counted, rather than the part up to the overflow.
+	bool complete = false;
 };
 
-void write_data_streams(level_file_context& context) {
-	const std::size_t reduced_width = (context.layer_size.width - 1) / word_size + 1;
-	const std::size_t rounded_width = reduced_width * word_size;
-	std::vector<std::size_t> words(context.layer_size.height * reduced_width);
-	std::map<std::vector<unsigned>, std::size_t> tile_dictionary {{std::vector<unsigned>(word_size, 0), 0}};
-	auto word_it = words.begin();
-	for (auto&& layer_row : context.layer) {
-		layer_row.resize(rounded_width);
-		for (auto it = layer_row.begin(); it != layer_row.end(); it += word_size) {
-			const auto result = tile_dictionary.emplace(std::vector<unsigned>(it, it + word_size), tile_dictionary.size());
-			*word_it++ = result.first->second;
+// Prints the report as records of space-separated fields, one per line: the
+// budget, the number of distinct tiles and whether it covers the whole layer,
+// the row and column of the first tile over budget, and every row that
+// introduced new tiles with their number, most new tiles first.
+void print_budget_report(std::ostream& out, const tile_budget_report& report) {
+	out << "budget " << max_tiles << '\n';
+	out << "distinct " << report.distinct_tiles << ' ' << (report.complete ? "complete" : "partial") << '\n';
+	out << "overflow " << report.overflow_index / report.layer_size.width << ' ' << report.overflow_index % report.layer_size.width << '\n';
+	std::vector<std::size_t> rows(report.new_tiles.size());
+	std::iota(rows.begin(), rows.end(), std::size_t(0));
+	std::stable_sort(rows.begin(), rows.end(), [&report](std::size_t lhs, std::size_t rhs) {
+		return report.new_tiles[lhs] > report.new_tiles[rhs];
+	});
+	for (const std::size_t row : rows) {
+		if (report.new_tiles[row] == 0)
+			break;
+		out << "row " << row << ' ' << report.new_tiles[row] << '\n';
+	}
+	out << std::flush;
+}
+
+// Tells distinct tiles apart by kind and fingerprint alone, without keeping or
+// comparing them, for when only the size of an oversized tileset matters.
+class tile_fingerprint_counter {
+public:
+	explicit tile_fingerprint_counter(const uniform_tile_ids& uniform_ids) noexcept {
+		for (std::size_t kind = 0; kind != uniform_tile_kinds; kind++) {
+			uniform_seen[kind] = uniform_ids.ids[kind] != no_uniform_tile_id;
 		}
 	}
-	const std::size_t dictionary_size = tile_dictionary.size();
-	std::vector<std::vector<unsigned>> ordered_dictionary(dictionary_size);
-	for (const auto& [word_content, word_id] : tile_dictionary) {
-		gsl::at(ordered_dictionary, word_id) = word_content;
+	// Whether no tile of the kind and, for general tiles, the fingerprint was seen before.
+	bool insert(std::uint16_t kind, std::uint64_t fingerprint) {
+		if (kind != general_tile_kind)
+			return !std::exchange(uniform_seen[kind], true);
+		return fingerprints.insert(fingerprint).second;
 	}
-	std::ofstream stream3("Stream3", std::ios::binary);
-	for (const auto& word : ordered_dictionary) {
-		for (const auto& tile : word) {
-			write_binary<endian::little>(stream3, gsl::narrow_cast<std::uint16_t>(tile));
+private:
+	std::array<bool, uniform_tile_kinds> uniform_seen;
+	std::unordered_set<std::uint64_t> fingerprints;
+};
+
+// Deduplicates streamed tiles in order on this thread, one band at a time as
+// they arrive. Stops at the first tile over budget, unless options ask to count
+// the rest of the distinct tiles by fingerprint.
+template<class Store>
+void dedup_tiles_streamed(input_contexts& inputs, std::deque<band_queue>& band_queues, level_file_context& level, tile_dictionary_t& tiles,
+	uniform_tile_ids& uniform_ids, Store&& store, const program_options& options, tile_path_stats& stats, tile_budget_report& report)
+{
+	std::optional<tile_fingerprint_counter> counter;
+	std::size_t index = 0;
+	for (std::size_t y = 0; y != level.layer.size().height; y++) {
+		bool band_available = true;
+		for (gsl::index i = 0; i < image_count && band_available; i++) {
+			band_available = next_tile_band(gsl::at(inputs, i), gsl::at(band_queues, i), options.repack);
+		}
+		if (!band_available)
+			return;
+		mask_to_binary(inputs[1].buffer);
+		for (auto&& layer_tile : level.layer.row(y)) {
+			tile_t tile;
+			for (gsl::index i = 0; i < image_count; i++) {
+				auto& context = gsl::at(inputs, i);
+				gsl::at(tile, i) = *context.tiles_it;
+				++context.tiles_it;
+			}
+			if (counter) {
+				const std::uint16_t kind = classify_tile(tile);
+				stats.count(kind);
+				const std::uint64_t fingerprint = kind == general_tile_kind ? tiles.hash_function()(make_tile_key(tile, options.flip)) : 0;
+				if (counter->insert(kind, fingerprint)) {
+					report.add(index);
+				}
+			} else {
+				const std::size_t tile_count = tiles.size();
+				layer_tile = resolve_tile(tiles, uniform_ids, tile, options.flip, store, stats);
+				if (tiles.size() != tile_count) {
+					report.add(index);
+				}
+				if (report.exceeded()) {
+					if (!options.count_overflow) {
+						report.complete = index + 1 == grid_area(level.layer.size());
+						return;
+					}
+					counter.emplace(uniform_ids);
+					for (const auto& value : tiles.values()) {
+						counter->insert(general_tile_kind, tiles.hash_function()(value));
+					}
+				}
+			}
+			index++;
 		}
 	}
-	std::ofstream stream4("Stream4", std::ios::binary);
-	for (const auto& word : words) {
-		write_binary<endian::little>(stream4, gsl::narrow_cast<std::uint16_t>(word));
+	report.complete = true;
+}
+
+// The distinct tiles among the tiles of the layer whose fingerprints fall into one shard.
+struct tile_shard {
+	tile_dictionary_t tiles;
+	// Index of the first occurrence of every distinct tile in the layer, by ID in the shard.
+	std::vector<std::size_t> first_occurrences;
+	// ID in the shard of every tile of the shard, in layer order.
+	std::vector<tile_dictionary_t::id_type> ids;
+};
+
+// Gives every tile of the layer the entry that resolving the tiles one by one in
+// row-major order would, using thread_count threads. The layer is processed in
+// chunks of rows, so that the work stops soon after the tileset goes over
+// budget. In every chunk, the tiles are classified, and the general ones
+// oriented and fingerprinted, in row bands. General tiles are then deduplicated
+// in shards by fingerprint, so no tile has duplicates outside of its shard. The
+// new distinct tiles of all shards and the new uniform tiles are finally added
+// to the dictionary in order of first occurrence. Needs the complete tile lists
+// of all inputs.
+template<class Store>
+void dedup_tiles_parallel(const input_contexts& inputs, level_file_context& level, tile_dictionary_t& tiles, uniform_tile_ids& uniform_ids,
+	Store&& store, const program_options& options, unsigned thread_count, tile_path_stats& stats, tile_budget_report& report)
+{
+	const grid_size size = level.layer.size();
+	const std::size_t tile_count = grid_area(size);
+	const std::size_t chunk_rows = std::max<std::size_t>(dedup_chunk_tiles / std::max<std::size_t>(size.width, 1), 1);
+	const std::size_t shard_count = thread_count;
+	const auto shard_of = [shard_count](std::uint64_t fingerprint) { return static_cast<std::size_t>(fingerprint % shard_count); };
+	std::vector<std::uint64_t> fingerprints(tile_count);
+	std::vector<unsigned char> flips(tile_count);
+	std::vector<std::uint16_t> kinds(tile_count);
+	std::vector<tile_shard> shards;
+	shards.reserve(shard_count);
+	for (std::size_t shard = 0; shard != shard_count; shard++) {
+		shards.push_back({tile_dictionary_t(std::min<std::size_t>(tile_count / shard_count, max_tiles) + 1), {}, {}});
 	}
+	// The dictionary ID of every distinct tile of every shard, by ID in the shard.
+	std::vector<std::vector<tile_dictionary_t::id_type>> layer_ids(shard_count);
+	std::optional<tile_fingerprint_counter> counter;
+	for (std::size_t first_row = 0; first_row < size.height; first_row += chunk_rows) {
+		const std::size_t last_row = std::min(first_row + chunk_rows, size.height);
+		const std::size_t band_count = std::min<std::size_t>(thread_count, last_row - first_row);
+		const auto band_first_row = [&](std::size_t band) { return first_row + band * (last_row - first_row) / band_count; };
+		// Number of general tiles of every band in every shard, later turned into the
+		// position of the band's first tile among the IDs of the shard.
+		std::vector<std::vector<std::size_t>> band_offsets(band_count, std::vector<std::size_t>(shard_count));
+		// Index of the first occurrence of every uniform tile in every band, or tile_count.
+		std::vector<std::array<std::size_t, uniform_tile_kinds>> band_uniform_tiles(band_count);
+		std::vector<tile_path_stats> band_stats(band_count);
+		run_parallel(band_count, [&](std::size_t band) {
+			auto& offsets = band_offsets[band];
+			auto& uniform_tiles = band_uniform_tiles[band];
+			uniform_tiles.fill(tile_count);
+			for (std::size_t index = band_first_row(band) * size.width; index != band_first_row(band + 1) * size.width; index++) {
+				const tile_t tile = get_tile(inputs, index);
+				kinds[index] = classify_tile(tile);
+				band_stats[band].count(kinds[index]);
+				if (kinds[index] != general_tile_kind) {
+					uniform_tiles[kinds[index]] = std::min(uniform_tiles[kinds[index]], index);
+					continue;
+				}
+				const tile_key key = make_tile_key(tile, options.flip);
+				flips[index] = gsl::narrow_cast<unsigned char>(key.flip);
+				fingerprints[index] = tiles.hash_function()(key);
+				offsets[shard_of(fingerprints[index])]++;
+			}
+		});
+		for (const auto& band : band_stats) {
+			stats += band;
+		}
+		if (counter) {
+			for (std::size_t index = first_row * size.width; index != last_row * size.width; index++) {
+				if (counter->insert(kinds[index], fingerprints[index])) {
+					report.add(index);
+				}
+			}
+			continue;
+		}
+		std::vector<std::size_t> old_sizes(shard_count);
+		for (std::size_t shard = 0; shard != shard_count; shard++) {
+			old_sizes[shard] = shards[shard].first_occurrences.size();
+			// Start the band offsets of the shard after its IDs from earlier chunks.
+			std::size_t offset = shards[shard].ids.size();
+			for (auto&& offsets : band_offsets) {
+				offset += std::exchange(offsets[shard], offset);
+			}
+		}
+		run_parallel(shard_count, [&](std::size_t shard_index) {
+			auto& shard = shards[shard_index];
+			for (std::size_t index = first_row * size.width; index != last_row * size.width; index++) {
+				if (kinds[index] != general_tile_kind || shard_of(fingerprints[index]) != shard_index)
+					continue;
+				const auto [id, inserted] = shard.tiles.emplace({get_tile(inputs, index), flips[index]}, fingerprints[index], keep_tile);
+				if (inserted) {
+					shard.first_occurrences.push_back(index);
+				}
+				shard.ids.push_back(id);
+				// The IDs of the shard run out, so the tileset is far too large anyway.
+				if (shard.tiles.size() == tile_dictionary_t::max_size)
+					break;
+			}
+		});
+		// Uniform tiles are told apart by a shard index of shard_count, with their kind as the ID.
+		struct distinct_tile {
+			std::size_t first_occurrence;
+			std::size_t shard;
+			std::uint16_t id;
+		};
+		std::vector<distinct_tile> distinct_tiles;
+		for (std::size_t shard = 0; shard != shard_count; shard++) {
+			const auto& first_occurrences = shards[shard].first_occurrences;
+			for (std::size_t id = old_sizes[shard]; id != first_occurrences.size(); id++) {
+				distinct_tiles.push_back({first_occurrences[id], shard, gsl::narrow_cast<std::uint16_t>(id)});
+			}
+			layer_ids[shard].resize(first_occurrences.size());
+		}
+		for (std::uint16_t kind = 0; kind != uniform_tile_kinds; kind++) {
+			if (uniform_ids.ids[kind] != no_uniform_tile_id)
+				continue;
+			std::size_t first_occurrence = tile_count;
+			for (const auto& uniform_tiles : band_uniform_tiles) {
+				first_occurrence = std::min(first_occurrence, uniform_tiles[kind]);
+			}
+			if (first_occurrence != tile_count) {
+				distinct_tiles.push_back({first_occurrence, shard_count, kind});
+			}
+		}
+		std::sort(distinct_tiles.begin(), distinct_tiles.end(), [](const distinct_tile& lhs, const distinct_tile& rhs) {
+			return lhs.first_occurrence < rhs.first_occurrence;
+		});
+		for (const auto& tile : distinct_tiles) {
+			report.add(tile.first_occurrence);
+			// Tiles over budget are only counted.
+			if (report.exceeded())
+				continue;
+			if (tile.shard == shard_count) {
+				uniform_ids.ids[tile.id] = tiles.emplace({get_tile(inputs, tile.first_occurrence), no_flip}, store).first;
+			} else {
+				const auto& shard = shards[tile.shard];
+				layer_ids[tile.shard][tile.id] = tiles.emplace(shard.tiles.values()[tile.id], fingerprints[tile.first_occurrence], store).first;
+			}
+		}
+		if (report.exceeded()) {
+			// Every tile of the chunk was counted, so stopping after the last chunk leaves none out.
+			if (!options.count_overflow) {
+				report.complete = last_row == size.height;
+				return;
+			}
+			counter.emplace(uniform_ids);
+			for (const auto& tile : distinct_tiles) {
+				counter->insert(tile.shard == shard_count ? tile.id : general_tile_kind, fingerprints[tile.first_occurrence]);
+			}
+			for (const auto& shard : shards) {
+				for (const std::size_t first_occurrence : shard.first_occurrences) {
+					counter->insert(general_tile_kind, fingerprints[first_occurrence]);
+				}
+			}
+			continue;
+		}
+		run_parallel(band_count, [&](std::size_t band) {
+			auto positions = band_offsets[band];
+			for (std::size_t y = band_first_row(band); y != band_first_row(band + 1); y++) {
+				const auto layer_row = level.layer.row(y);
+				for (std::size_t x = 0; x != size.width; x++) {
+					const std::size_t index = y * size.width + x;
+					if (kinds[index] != general_tile_kind) {
+						layer_row[x] = gsl::narrow_cast<std::uint16_t>(uniform_ids.ids[kinds[index]]);
+						continue;
+					}
+					const std::size_t shard = shard_of(fingerprints[index]);
+					const auto id = layer_ids[shard][shards[shard].ids[positions[shard]++]];
+					layer_row[x] = layer_entry(id, tiles.values()[id].flip ^ flips[index]);
+				}
+			}
+		});
+	}
+	report.complete = true;
 }
 
 int main(int argc, char* argv[]) try {
 	const gsl::span<char*> arguments(argv, argc);
-	if (arguments.size() != image_count + 1) {
-		std::cerr << "PicToLev expects exactly " << image_count << " arguments" << std::endl;
+	program_options options;
+	if (!parse_arguments(arguments, options))
 		return 1;
-	}
+	stage_clock stages;
 	image_file_context<const unsigned char> inputs[image_count];
 	for (gsl::index i = 0; i < image_count; i++) {
 		auto& input = gsl::at(inputs, i);
-		input.filename = arguments[i + 1];
-		if (i != 0) {
-			input.known_size = true;
-			input.size = inputs[0].size;
-		} else {
-			input.known_size = false;
-		}
+		input.filename = gsl::at(options.filenames, i);
 		input.state.decoder.color_convert = false;
 		input.state.info_raw.colortype = LCT_PALETTE;
-		if (!get_tile_list(input))
+		if (!open_image(input))
 			return 1;
 	}
-	for (auto&& index : inputs[1].buffer) {
-		index = index != 0;
+	for (gsl::index i = 1; i < image_count; i++) {
+		const auto& input = gsl::at(inputs, i);
+		if (input.size.width != inputs[0].size.width || input.size.height != inputs[0].size.height) {
+			std::cerr << "File " << input.filename << " has incorrect image size\n";
+			std::cerr << "Sizes of all images must be equal" << std::endl;
+			return 1;
+		}
 	}
-	level_file_context level;
-	level.layer_size.width = inputs[0].size.width / tileset_tile_size;
-	level.layer_size.height = inputs[0].size.height / tileset_tile_size;
-	level.layer.assign(level.layer_size.height, std::vector<unsigned>(level.layer_size.width));
-	using image_t = image_fragment<const unsigned char>;
-	using tile_t = std::vector<image_t>;
-	tile_t empty_tile(image_count, image_t(tileset_tile_size, gsl::span<const unsigned char>(empty_tile_row)));
-	std::unordered_map<tile_t, std::size_t, container_deep_hash_t<tile_t, std::hash<unsigned char>>> tiles {{std::move(empty_tile), 0}};
-	for (auto&& context : inputs) {
-		context.tiles_it = context.tiles.begin();
-	}
-	for (auto&& layer_row : level.layer) {
-		for (auto&& layer_tile : layer_row) {
-			tile_t tile;
-			for (auto&& context : inputs) {
-				tile.emplace_back(std::move(*context.tiles_it));
-				++context.tiles_it;
-			}
-			const auto result = tiles.emplace(std::move(tile), tiles.size());
-			layer_tile = gsl::narrow_cast<unsigned>(result.first->second);
+	std::deque<band_queue> band_queues;
+	std::ostringstream decode_logs[image_count];
+	std::future<bool> decode_results[image_count];
+	const auto collect_decode_results = [&decode_logs, &decode_results]() {
+		bool decode_success = true;
+		for (gsl::index i = 0; i < image_count; i++) {
+			decode_success &= gsl::at(decode_results, i).get();
+			std::cerr << gsl::at(decode_logs, i).str();
+		}
+		return decode_success;
+	};
+	const auto abort_streams = [&band_queues]() {
+		for (auto&& bands : band_queues) {
+			bands.abort();
+		}
+	};
+	const auto abort_streams_on_exit = gsl::finally(abort_streams);
+	for (gsl::index i = 0; i < image_count; i++) {
+		auto& input = gsl::at(inputs, i);
+		auto& log = gsl::at(decode_logs, i);
+		if (options.stream) {
+			auto& bands = band_queues.emplace_back(stream_queue_capacity);
+			gsl::at(decode_results, i) = std::async(std::launch::async, stream_tile_bands, std::ref(input), std::ref(bands), std::ref(log));
+		} else {
+			gsl::at(decode_results, i) = std::async(std::launch::async, get_tile_list, std::ref(input), options.repack, std::ref(log));
 		}
 	}
-	const unsigned tile_count = gsl::narrow_cast<unsigned>(tiles.size());
-	if (tile_count > max_tiles) {
+	if (!options.stream) {
+		if (!collect_decode_results())
+			return 1;
+		mask_to_binary(inputs[1].buffer);
+		if (options.timing)
+			std::cerr << "decode: " << stages.lap() << " ms" << std::endl;
+	}
+	level_file_context level;
+	level.layer = grid<std::uint16_t>({inputs[0].size.width / tileset_tile_size, inputs[0].size.height / tileset_tile_size}, word_size);
+	tile_t empty_tile;
+	empty_tile.fill(image_t(empty_tile_row, 0));
+	tile_dictionary_t tiles(grid_area(level.layer.size()) + 1);
+	tiles.emplace({empty_tile, no_flip}, keep_tile);
+	image_file_context<unsigned char> outputs[image_count];
+	init_tileset_images(outputs);
+	const auto store = [&outputs](const tile_key& key, std::size_t id) { return store_tile(outputs, key, id); };
+	uniform_tile_ids uniform_ids;
+	tile_path_stats path_stats;
+	tile_budget_report budget_report(level.layer.size());
+	const unsigned thread_count = options.threads != 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+	if (options.stream) {
+		dedup_tiles_streamed(inputs, band_queues, level, tiles, uniform_ids, store, options, path_stats, budget_report);
+	} else {
+		dedup_tiles_parallel(inputs, level, tiles, uniform_ids, store, options, thread_count, path_stats, budget_report);
+	}
+	if (options.stream) {
+		abort_streams();
+		if (!collect_decode_results())
+			return 1;
+	}
+	if (options.timing) {
+		std::cerr << (options.stream ? "decode and tiles: " : "tiles: ") << stages.lap() << " ms (";
+		std::cerr << path_stats.empty << " empty, " << path_stats.uniform << " uniform, ";
+		std::cerr << path_stats.hashed << " hashed)" << std::endl;
+	}
+	if (options.dictionary_stats) {
+		const auto stats = tiles.stats();
+		std::cerr << "tile dictionary: " << stats.size << " tiles in " << stats.capacity << " slots (load factor ";
+		std::cerr << tiles.load_factor() << "), " << stats.lookups << " lookups, " << stats.probes << " probes, ";
+		std::cerr << "longest probe " << stats.max_probe_length << ", " << stats.comparisons << " comparisons" << std::endl;
+		std::cerr << "tile paths: " << path_stats.empty << " empty, " << path_stats.uniform << " uniform, ";
+		std::cerr << path_stats.hashed << " hashed" << std::endl;
+	}
+	if (budget_report.exceeded()) {
 		std::cerr << "The resulting tileset would have more than ";
 		std::cerr << max_tiles << " tiles" << std::endl;
+		print_budget_report(std::cout, budget_report);
 		return 1;
 	}
+	const unsigned tile_count = gsl::narrow_cast<unsigned>(tiles.size());
 	const unsigned tileset_height = (tile_count - 1) / tileset_width + 1;
 	const unsigned tileset_image_height = tileset_height * tileset_tile_size;
 	grid_size tileset_image_size {
 		tileset_image_width,
 		tileset_image_height,
 	};
-	image_file_context<unsigned char> outputs[image_count];
+	lodepng_arena encode_arena;
+	const parallel_deflate_options deflate_options {thread_count};
 	for (gsl::index i = 0; i < image_count; i++) {
 		const auto& input = gsl::at(inputs, i);
 		auto& output = gsl::at(outputs, i);
 		output.size = tileset_image_size;
-		output.buffer.assign(grid_area(tileset_image_size), 0);
-		const auto output_image = buffer_to_image(gsl::make_span(output.buffer), tileset_image_size);
-		output.tiles = image_to_tile_list(output_image.begin(), output_image.end(), tileset_tile_size);
-		for (const auto& [tile_content, tile_id] : tiles) {
-			const auto& src = gsl::at(tile_content, i);
-			const auto& dest = gsl::at(output.tiles, tile_id);
-			auto out = dest.begin();
-			for (auto it = src.begin(); it != src.end(); ++it, ++out) {
-				std::copy(it->begin(), it->end(), out->begin());
-			}
-		}
+		Expects(output.buffer.size() == grid_area(tileset_image_size));
 		const std::string file_prefix = input.filename.substr(0, input.filename.rfind('.'));
 		output.filename = file_prefix + "-output-" + std::to_string(i + 1) + ".png";
 		output.state = input.state;
 		output.state.encoder.auto_convert = false;
 		output.state.info_raw.colortype = LCT_PALETTE;
+		output.state.encoder.zlibsettings.custom_zlib = parallel_zlib_compress;
+		output.state.encoder.zlibsettings.custom_context = &deflate_options;
 		std::vector<unsigned char> file_buffer;
-		int error = lodepng::encode(file_buffer, output.buffer, tileset_image_width, tileset_image_height, output.state);
+		int error;
+		{
+			const lodepng_arena_scope arena_scope(encode_arena);
+			error = encode_at_level(file_buffer, output.buffer, tileset_image_width, tileset_image_height, output.state, options.compression);
+		}
+		encode_arena.reset();
 		if (error != 0) {
 			std::cerr << "An error has occurred when decoding file ";
 			std::cerr << output.filename << ":\n";
@@ -229,7 +948,17 @@ int main(int argc, char* argv[]) try {
 			return 1;
 		}
 	}
-	write_data_streams(level);
+	if (options.timing)
+		std::cerr << "encode: " << stages.lap() << " ms" << std::endl;
+	if (!write_data_streams(level, thread_count))
+		return 1;
+	if (options.timing)
+		std::cerr << "data streams: " << stages.lap() << " ms" << std::endl;
+	if (options.alloc_stats) {
+		const auto stats = get_lodepng_allocation_stats();
+		std::cerr << "lodepng allocations: " << stats.heap_allocations << " from the heap, ";
+		std::cerr << stats.arena_allocations << " from arenas, " << stats.frees << " frees" << std::endl;
+	}
 	return 0;
 } catch (const std::exception& e) {
 	std::cerr << "An unexpected runtime error has occurred:\n";
@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#include "mapped_file.h"
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <gsl/gsl_util>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	constexpr std::size_t read_chunk_size = 1 << 16;
+
+	std::error_code last_error() noexcept {
+#ifdef _WIN32
+		return {gsl::narrow_cast<int>(GetLastError()), std::system_category()};
+#else
+		return {errno, std::system_category()};
+#endif
+	}
+
+#ifdef _WIN32
+	std::error_code read_all(HANDLE file, std::vector<unsigned char>& buffer) {
+		buffer.clear();
+		for (;;) {
+			const std::size_t offset = buffer.size();
+			buffer.resize(offset + read_chunk_size);
+			DWORD count = 0;
+			if (!ReadFile(file, buffer.data() + offset, read_chunk_size, &count, nullptr)) {
+				const DWORD error = GetLastError();
+				buffer.resize(offset);
+				if (error == ERROR_BROKEN_PIPE || error == ERROR_HANDLE_EOF)
+					return {};
+				return {gsl::narrow_cast<int>(error), std::system_category()};
+			}
+			buffer.resize(offset + count);
+			if (count == 0)
+				return {};
+		}
+	}
+#else
+	std::error_code read_all(int fd, std::vector<unsigned char>& buffer) {
+		buffer.clear();
+		for (;;) {
+			const std::size_t offset = buffer.size();
+			buffer.resize(offset + read_chunk_size);
+			const ssize_t count = read(fd, buffer.data() + offset, read_chunk_size);
+			if (count < 0) {
+				buffer.resize(offset);
+				if (errno == EINTR)
+					continue;
+				return last_error();
+			}
+			buffer.resize(offset + gsl::narrow_cast<std::size_t>(count));
+			if (count == 0)
+				return {};
+		}
+	}
+#endif
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept :
+	view(std::exchange(other.view, nullptr)),
+	view_size(std::exchange(other.view_size, 0)),
+	mapped(std::exchange(other.mapped, false)),
+	fallback(std::move(other.fallback)) {}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+	if (this != &other) {
+		close();
+		view = std::exchange(other.view, nullptr);
+		view_size = std::exchange(other.view_size, 0);
+		mapped = std::exchange(other.mapped, false);
+		fallback = std::move(other.fallback);
+	}
+	return *this;
+}
+
+mapped_file::~mapped_file() {
+	close();
+}
+
+std::error_code mapped_file::open(const std::string& filename) {
+	close();
+	const std::error_code error = map(filename);
+	if (!mapped) {
+		view = fallback.data();
+		view_size = fallback.size();
+	}
+	return error;
+}
+
+void mapped_file::close() noexcept {
+	if (mapped) {
+#ifdef _WIN32
+		UnmapViewOfFile(view);
+#else
+		munmap(const_cast<unsigned char*>(view), view_size);
+#endif
+	}
+	view = nullptr;
+	view_size = 0;
+	mapped = false;
+	fallback.clear();
+	fallback.shrink_to_fit();
+}
+
+#ifdef _WIN32
+std::error_code mapped_file::map(const std::string& filename) {
+	const HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return last_error();
+	const auto file_guard = gsl::finally([file]() { CloseHandle(file); });
+	LARGE_INTEGER size;
+	if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		return read_all(file, fallback);
+	const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+		return read_all(file, fallback);
+	const auto mapping_guard = gsl::finally([mapping]() { CloseHandle(mapping); });
+	const void* address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (address == nullptr)
+		return read_all(file, fallback);
+	view = static_cast<const unsigned char*>(address);
+	view_size = gsl::narrow_cast<std::size_t>(size.QuadPart);
+	mapped = true;
+	return {};
+}
+#else
+std::error_code mapped_file::map(const std::string& filename) {
+	const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return last_error();
+	const auto fd_guard = gsl::finally([fd]() { ::close(fd); });
+	struct stat status {};
+	if (fstat(fd, &status) == -1)
+		return last_error();
+	if (!S_ISREG(status.st_mode) || status.st_size == 0)
+		return read_all(fd, fallback);
+	const auto size = gsl::narrow_cast<std::size_t>(status.st_size);
+	void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (address == MAP_FAILED)
+		return read_all(fd, fallback);
+	madvise(address, size, MADV_SEQUENTIAL);
+	madvise(address, size, MADV_WILLNEED);
+	view = static_cast<const unsigned char*>(address);
+	view_size = size;
+	mapped = true;
+	return {};
+}
+#endif
@@ -0,0 +1,126 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#include "parallel_deflate.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <new>
+#include <vector>
+#include <lodepng.h>
+#include "lodepng_arena.h"
+
+namespace {
+	struct deflated_piece {
+		deflated_piece() noexcept = default;
+		deflated_piece(const deflated_piece&) = delete;
+		deflated_piece& operator=(const deflated_piece&) = delete;
+		~deflated_piece() {
+			lodepng_free(data);
+		}
+		std::size_t start = 0;
+		std::size_t end = 0;
+		unsigned char* data = nullptr;
+		std::size_t size = 0;
+		unsigned adler = 1;
+		unsigned error = 0;
+	};
+
+	void deflate_piece(deflated_piece& piece, const unsigned char* in, std::size_t insize,
+		const LodePNGCompressSettings* settings) {
+		piece.error = lodepng_deflate_range(&piece.data, &piece.size, in, insize, piece.start, piece.end, settings);
+		piece.adler = lodepng_update_adler32(1, in + piece.start, piece.end - piece.start);
+	}
+
+	void store_big_endian(unsigned char* out, unsigned value) noexcept {
+		out[0] = static_cast<unsigned char>(value >> 24);
+		out[1] = static_cast<unsigned char>(value >> 16);
+		out[2] = static_cast<unsigned char>(value >> 8);
+		out[3] = static_cast<unsigned char>(value);
+	}
+}
+
+unsigned parallel_zlib_compress(unsigned char** out, std::size_t* outsize, const unsigned char* in, std::size_t insize,
+	const LodePNGCompressSettings* settings) try {
+	const auto& options = *static_cast<const parallel_deflate_options*>(settings->custom_context);
+	const std::size_t min_piece_size = std::max<std::size_t>(options.min_piece_size, 1);
+	// The pieces depend only on the input, so the output is the same for any number of threads.
+	const std::size_t piece_count = std::max<std::size_t>(insize / min_piece_size, 1);
+	const std::size_t piece_size = (insize + piece_count - 1) / piece_count;
+	std::vector<deflated_piece> pieces(piece_count);
+	for (std::size_t i = 0; i != piece_count; i++) {
+		pieces[i].start = std::min(i * piece_size, insize);
+		pieces[i].end = std::min(pieces[i].start + piece_size, insize);
+	}
+	const std::size_t worker_count = std::max<std::size_t>(std::min<std::size_t>(options.thread_count, piece_count), 1);
+	const auto deflate_pieces = [&pieces, in, insize, settings, worker_count](std::size_t worker) {
+		for (std::size_t i = worker; i < pieces.size(); i += worker_count) {
+			deflate_piece(pieces[i], in, insize, settings);
+		}
+	};
+	// Worker 0 runs on the calling thread, which may have an arena for lodepng's allocations.
+	std::vector<std::future<void>> results;
+	for (std::size_t worker = 1; worker < worker_count; worker++) {
+		results.push_back(std::async(std::launch::async, deflate_pieces, worker));
+	}
+	deflate_pieces(0);
+	for (auto&& result : results) {
+		result.get();
+	}
+	unsigned error = 0;
+	std::size_t deflated_size = 0;
+	unsigned adler = pieces[0].adler;
+	for (std::size_t i = 0; i != piece_count; i++) {
+		if (error == 0)
+			error = pieces[i].error;
+		deflated_size += pieces[i].size;
+		if (i != 0)
+			adler = lodepng_adler32_combine(adler, pieces[i].adler, pieces[i].end - pieces[i].start);
+	}
+	unsigned char* buffer = nullptr;
+	if (error == 0) {
+		// CMF 0x78 selects deflate with a 32K window, and FLG 0x01 makes the header a multiple of 31.
+		buffer = static_cast<unsigned char*>(lodepng_realloc(*out, *outsize + 2 + deflated_size + 4));
+		if (!buffer)
+			error = 83;
+	}
+	if (error == 0) {
+		unsigned char* position = buffer + *outsize;
+		*position++ = 0x78;
+		*position++ = 0x01;
+		for (const auto& piece : pieces) {
+			if (piece.size != 0)
+				std::memcpy(position, piece.data, piece.size);
+			position += piece.size;
+		}
+		store_big_endian(position, adler);
+		*out = buffer;
+		*outsize += 2 + deflated_size + 4;
+	}
+	return error;
+} catch (const std::bad_alloc&) {
+	return 83;
+}
@@ -0,0 +1,59 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+#include "uniform_rows.h"
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PICTOLEV_UNIFORM_ROWS_SSE2
+#endif
+
+bool uniform_rows(const unsigned char* data, std::ptrdiff_t stride, std::size_t row_count, std::size_t row_size, unsigned char value) noexcept {
+	std::size_t vector_size = 0;
+#ifdef PICTOLEV_UNIFORM_ROWS_SSE2
+	vector_size = row_size & ~std::size_t {15};
+	const __m128i pattern = _mm_set1_epi8(static_cast<char>(value));
+#endif
+	for (std::size_t y = 0; y != row_count; y++, data += stride) {
+		std::size_t x = 0;
+#ifdef PICTOLEV_UNIFORM_ROWS_SSE2
+		// The differences of a whole row are gathered before the one branch on them.
+		__m128i differences = _mm_setzero_si128();
+		for (; x != vector_size; x += 16) {
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + x));
+			differences = _mm_or_si128(differences, _mm_xor_si128(bytes, pattern));
+		}
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(differences, _mm_setzero_si128())) != 0xFFFF)
+			return false;
+#endif
+		unsigned remainder_differences = 0;
+		for (; x != row_size; x++) {
+			remainder_differences |= data[x] ^ value;
+		}
+		if (remainder_differences != 0)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,163 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Checks the slicing-by-8 and PCLMUL CRC-32, lodepng_crc32 and the SSE2
+// Adler-32 against the byte-at-a-time table CRC and the scalar Adler-32 they
+// replaced. Every length up to 300 is checked at every start in 16 bytes, then
+// lengths around the 64-byte PCLMUL and 5552-byte Adler-32 blocks and random
+// lengths up to 100000 at random starts. Adler-32 is also checked when updated
+// from a state other than the initial one. lodepng.cpp is included to reach its
+// internal functions.
+
+#include "../src/lodepng.cpp"
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+	// The original lodepng_crc32.
+	unsigned crc32_table(unsigned r, const unsigned char* data, std::size_t length) {
+		for (std::size_t i = 0; i != length; i++) {
+			r = lodepng_crc32_table[(r ^ data[i]) & 0xff] ^ (r >> 8);
+		}
+		return r;
+	}
+
+	unsigned crc32_slices(unsigned r, const unsigned char* data, std::size_t length) {
+		return crc32_slicing8(r, data, length);
+	}
+
+#ifdef LODEPNG_SIMD_X86
+	// lodepng_crc32 with PCLMUL forced, as it is for lengths of 64 bytes and more.
+	unsigned crc32_pclmul(unsigned r, const unsigned char* data, std::size_t length) {
+		if (length >= 64) {
+			const std::size_t folded = length & ~std::size_t {15};
+			r = crc32_PCLMUL(r, data, folded);
+			data += folded;
+			length -= folded;
+		}
+		return crc32_slicing8(r, data, length);
+	}
+#endif
+
+	unsigned crc32_lodepng(unsigned r, const unsigned char* data, std::size_t length) {
+		// lodepng_crc32 starts from and finishes with an inversion of all bits.
+		return r == 0xffffffffu ? lodepng_crc32(data, length) ^ 0xffffffffu : crc32_slicing8(r, data, length);
+	}
+
+	unsigned adler32_scalar(unsigned adler, const unsigned char* data, std::size_t length) {
+		return update_adler32_scalar(adler, data, static_cast<unsigned>(length));
+	}
+
+#ifdef LODEPNG_SIMD_X86
+	unsigned adler32_sse2(unsigned adler, const unsigned char* data, std::size_t length) {
+		return update_adler32_SSE2(adler, data, static_cast<unsigned>(length));
+	}
+#endif
+
+	unsigned adler32_lodepng(unsigned adler, const unsigned char* data, std::size_t length) {
+		return lodepng_update_adler32(adler, data, length);
+	}
+
+	using checksum_function = unsigned (*)(unsigned, const unsigned char*, std::size_t);
+
+	struct kernel {
+		const char* name;
+		checksum_function function;
+		checksum_function reference;
+		// States to start from; the first one is the initial state.
+		unsigned starts[2];
+		unsigned required_features;
+	};
+
+	const kernel kernels[] = {
+		{"CRC-32 slicing-by-8", crc32_slices, crc32_table, {0xffffffffu, 0x12345678u}, 0},
+#ifdef LODEPNG_SIMD_X86
+		{"CRC-32 PCLMUL", crc32_pclmul, crc32_table, {0xffffffffu, 0x12345678u}, LODEPNG_CPU_PCLMUL},
+#endif
+		{"CRC-32 lodepng_crc32", crc32_lodepng, crc32_table, {0xffffffffu, 0x12345678u}, 0},
+#ifdef LODEPNG_SIMD_X86
+		{"Adler-32 SSE2", adler32_sse2, adler32_scalar, {1, 0xfff0fff0u}, LODEPNG_CPU_SSE2},
+#endif
+		{"Adler-32 lodepng_update_adler32", adler32_lodepng, adler32_scalar, {1, 0xfff0fff0u}, 0},
+	};
+}
+
+int main() {
+	constexpr std::size_t max_length = 100000;
+	std::mt19937 random(2018);
+	// All bytes 255 maximize the Adler-32 sums, so they are checked before random bytes.
+	std::vector<unsigned char> saturated(max_length + 64, 255);
+	std::vector<unsigned char> noise(max_length + 64);
+	for (auto& value : noise) {
+		value = static_cast<unsigned char>(random());
+	}
+	std::vector<std::size_t> lengths;
+	for (std::size_t length = 0; length != 300; length++) {
+		lengths.push_back(length);
+	}
+	for (const std::size_t block : {64, 5552, 2 * 5552}) {
+		for (std::size_t length = block - 17; length != block + 18; length++) {
+			lengths.push_back(length);
+		}
+	}
+	const unsigned supported = lodepng_cpu_features();
+	int failures = 0;
+	for (const auto& k : kernels) {
+		if ((k.required_features & supported) != k.required_features) {
+			std::cout << k.name << ": not supported by this CPU, skipped" << std::endl;
+			continue;
+		}
+		int checks = 0;
+		const auto check = [&](const std::vector<unsigned char>& buffer, std::size_t offset, std::size_t length) {
+			for (const unsigned start : k.starts) {
+				if (k.function(start, &buffer[offset], length) != k.reference(start, &buffer[offset], length)) {
+					std::cerr << k.name << ": " << length << " bytes at offset " << offset << " from state " << start;
+					std::cerr << " differ from the reference" << std::endl;
+					failures++;
+				}
+				checks++;
+			}
+		};
+		for (const auto* buffer : {&saturated, &noise}) {
+			for (const std::size_t length : lengths) {
+				for (std::size_t offset = 0; offset != 16; offset++) {
+					check(*buffer, offset, length);
+				}
+			}
+		}
+		for (int i = 0; i != 200; i++) {
+			check(noise, random() % 64, random() % max_length);
+		}
+		check(noise, 0, max_length);
+		std::cout << k.name << ": " << checks << " checksums checked" << std::endl;
+	}
+	if (failures != 0) {
+		std::cerr << failures << " mismatches" << std::endl;
+		return 1;
+	}
+	std::cout << "All checksum kernels match the reference implementations" << std::endl;
+	return 0;
+}
@@ -0,0 +1,213 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Checks that dedup_tiles_parallel gives the tileset, layer and budget report
+// that the serial dedup_tiles_streamed gives, at several thread counts, on a
+// layer of several dedup_chunk_tiles chunks whose distinct tiles first occur
+// all over it.
+
+#include "pictolev_sources.h"
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Padded to whole words, and spanning three chunks.
+constexpr grid_size layer_size {50, 1400};
+constexpr grid_size image_size {layer_size.width * tileset_tile_size, layer_size.height * tileset_tile_size};
+static_assert(grid_area(layer_size) > 2 * dedup_chunk_tiles, "The layer must span more than two chunks");
+
+using tile_pixels = std::array<unsigned char, tileset_tile_size * tileset_tile_size>;
+
+// Builds the planes of a level out of tiles from a pool of general and uniform
+// tiles, in random mirror images. Tile i of the layer is drawn from the first
+// i / spread + 1 tiles of the pool, so new tiles keep turning up to the end.
+// Masks use several nonzero values, which PicToLev reads as one.
+std::vector<unsigned char> make_planes(std::mt19937& random, std::size_t general_tiles, std::size_t spread) {
+	std::vector<std::array<tile_pixels, image_count>> pool;
+	for (std::size_t i = 0; i != general_tiles; i++) {
+		std::array<tile_pixels, image_count> tile;
+		for (auto& pixel : tile[0]) {
+			pixel = static_cast<unsigned char>(random() % 4);
+		}
+		for (auto& pixel : tile[1]) {
+			pixel = static_cast<unsigned char>(random() % 2 * (random() % 255 + 1));
+		}
+		pool.push_back(tile);
+		// Every few tiles, a uniform one, which is sometimes empty.
+		if (i % 8 == 0) {
+			const auto colour = static_cast<unsigned char>(i % 3 == 0 ? 0 : random());
+			const auto mask = static_cast<unsigned char>(i % 5 == 0 ? 0 : random() % 255 + 1);
+			tile[0].fill(colour);
+			tile[1].fill(mask);
+			pool.push_back(tile);
+		}
+	}
+	std::vector<unsigned char> planes(image_count * grid_area(image_size));
+	for (std::size_t index = 0; index != grid_area(layer_size); index++) {
+		const auto& tile = pool[random() % std::min(index / spread + 1, pool.size())];
+		const unsigned flip = random() % tile_flip_count;
+		const std::size_t x = index % layer_size.width * tileset_tile_size;
+		const std::size_t y = index / layer_size.width * tileset_tile_size;
+		for (std::size_t i = 0; i != image_count; i++) {
+			unsigned char* plane = &planes[i * grid_area(image_size)];
+			for (std::size_t row = 0; row != tileset_tile_size; row++) {
+				for (std::size_t column = 0; column != tileset_tile_size; column++) {
+					const std::size_t source_row = flip & vertical_flip ? tileset_tile_size - 1 - row : row;
+					const std::size_t source_column = flip & horizontal_flip ? tileset_tile_size - 1 - column : column;
+					plane[(y + row) * image_size.width + x + column] = tile[i][source_row * tileset_tile_size + source_column];
+				}
+			}
+		}
+	}
+	return planes;
+}
+
+// What a deduplication produces.
+struct dedup_result {
+	std::vector<unsigned char> tilesets[image_count];
+	std::vector<std::uint16_t> layer;
+	std::size_t tile_count;
+	tile_path_stats stats;
+	tile_budget_report report {layer_size};
+};
+
+// Deduplicates the planes like main does, in parallel with thread_count
+// threads, or streamed in tile row bands on this thread if thread_count is 0.
+dedup_result dedup(const std::vector<unsigned char>& planes, const program_options& options, unsigned thread_count) {
+	input_contexts inputs;
+	std::deque<band_queue> band_queues;
+	std::future<void> producers[image_count];
+	for (gsl::index i = 0; i < image_count; i++) {
+		auto& input = gsl::at(inputs, i);
+		input.size = image_size;
+		const auto first = planes.begin() + i * grid_area(image_size);
+		if (thread_count != 0) {
+			input.buffer.assign(first, first + grid_area(image_size));
+			make_tile_list(input, image_size, options.repack);
+			continue;
+		}
+		auto& bands = band_queues.emplace_back(stream_queue_capacity);
+		gsl::at(producers, i) = std::async(std::launch::async, [&bands, first]() {
+			constexpr std::size_t band_size = image_size.width * tileset_tile_size;
+			for (std::size_t y = 0; y != layer_size.height; y++) {
+				bands.push(band_queue::band_type(first + y * band_size, first + (y + 1) * band_size));
+			}
+			bands.close();
+		});
+	}
+	if (thread_count != 0) {
+		mask_to_binary(inputs[1].buffer);
+	}
+	dedup_result result;
+	level_file_context level;
+	level.layer = grid<std::uint16_t>(layer_size, word_size);
+	tile_t empty_tile;
+	empty_tile.fill(image_t(empty_tile_row, 0));
+	tile_dictionary_t tiles(grid_area(layer_size) + 1);
+	tiles.emplace({empty_tile, no_flip}, keep_tile);
+	output_contexts outputs;
+	init_tileset_images(outputs);
+	const auto store = [&outputs](const tile_key& key, std::size_t id) { return store_tile(outputs, key, id); };
+	uniform_tile_ids uniform_ids;
+	if (thread_count != 0) {
+		dedup_tiles_parallel(inputs, level, tiles, uniform_ids, store, options, thread_count, result.stats, result.report);
+	} else {
+		dedup_tiles_streamed(inputs, band_queues, level, tiles, uniform_ids, store, options, result.stats, result.report);
+		for (auto&& bands : band_queues) {
+			bands.abort();
+		}
+		for (auto&& producer : producers) {
+			producer.get();
+		}
+	}
+	for (gsl::index i = 0; i < image_count; i++) {
+		gsl::at(result.tilesets, i) = std::move(gsl::at(outputs, i).buffer);
+	}
+	const auto elements = level.layer.elements();
+	result.layer.assign(elements.begin(), elements.end());
+	result.tile_count = tiles.size();
+	return result;
+}
+
+// Whether both results have the same tileset and layer, or, over budget, the same report.
+bool same_result(const dedup_result& lhs, const dedup_result& rhs) {
+	if (lhs.report.distinct_tiles != rhs.report.distinct_tiles || lhs.report.overflow_index != rhs.report.overflow_index ||
+		lhs.report.new_tiles != rhs.report.new_tiles || lhs.report.complete != rhs.report.complete)
+		return false;
+	if (lhs.report.exceeded())
+		return true;
+	return std::equal(std::begin(lhs.tilesets), std::end(lhs.tilesets), std::begin(rhs.tilesets)) &&
+		lhs.layer == rhs.layer && lhs.tile_count == rhs.tile_count &&
+		lhs.stats.empty == rhs.stats.empty && lhs.stats.uniform == rhs.stats.uniform && lhs.stats.hashed == rhs.stats.hashed;
+}
+
+}
+
+int main() {
+	std::mt19937 random(2018);
+	int failures = 0;
+	int checks = 0;
+	struct level_case {
+		std::size_t general_tiles;
+		bool flip;
+		bool repack;
+		bool count_overflow;
+	};
+	// The first levels fit the budget without flips, the last one only counts its tiles.
+	const level_case cases[] {
+		{800, false, false, false},
+		{800, true, true, false},
+		{3000, true, false, false},
+		{6000, false, true, true},
+	};
+	for (const auto& level : cases) {
+		const std::vector<unsigned char> planes = make_planes(random, level.general_tiles, grid_area(layer_size) / level.general_tiles);
+		program_options options;
+		options.flip = level.flip;
+		options.repack = level.repack;
+		options.count_overflow = level.count_overflow;
+		const dedup_result serial = dedup(planes, options, 0);
+		std::cout << serial.report.distinct_tiles << " distinct tiles" << (serial.report.exceeded() ? ", over budget" : "") << std::endl;
+		for (const unsigned thread_count : {1u, 2u, 3u, 5u, 8u}) {
+			const dedup_result parallel = dedup(planes, options, thread_count);
+			if (!same_result(serial, parallel)) {
+				std::cerr << "With " << thread_count << " threads and " << level.general_tiles << " tiles";
+				std::cerr << (level.flip ? " with" : " without") << " flips, the result differs from the serial one" << std::endl;
+				failures++;
+			}
+			checks++;
+		}
+	}
+	if (failures != 0) {
+		std::cerr << failures << " of " << checks << " parallel deduplications differ from the serial one" << std::endl;
+		return 1;
+	}
+	std::cout << checks << " parallel deduplications match the serial one" << std::endl;
+	return 0;
+}
@@ -0,0 +1,157 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Checks that make_level_words, which merges the word dictionaries of row bands,
+// numbers the words like a single row-major pass at every thread count, on
+// layers whose words recur across bands, and that it throws
+// tile_dictionary_full once a level has more than max_words distinct words.
+
+#include "pictolev_sources.h"
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Numbers the words of the layer in one row-major pass, starting with the empty word.
+level_words number_words(const level_file_context& context) {
+	level_words result {{0}, {}};
+	std::unordered_map<std::uint64_t, word_dictionary_t::id_type> ids {{0, 0}};
+	const auto entries = context.layer.elements();
+	const std::size_t word_count = gsl::narrow_cast<std::size_t>(entries.size()) / word_size;
+	for (std::size_t word = 0; word != word_count; word++) {
+		std::uint64_t packed = 0;
+		for (std::size_t i = 0; i != word_size; i++) {
+			packed |= std::uint64_t(entries[word * word_size + i]) << (i * 16);
+		}
+		const auto [it, inserted] = ids.emplace(packed, gsl::narrow_cast<word_dictionary_t::id_type>(result.dictionary.size()));
+		if (inserted) {
+			result.dictionary.push_back(packed);
+		}
+		result.words.push_back(it->second);
+	}
+	return result;
+}
+
+// A layer whose words come from a pool of distinct words, with word i drawn
+// from the first i / spread + 1 of them, so that the words of one band turn up
+// again in the bands after it. The width is not a whole number of words, so
+// the last word of every row is partly padding.
+level_file_context make_level(std::mt19937& random, grid_size size, std::size_t pool_size, std::size_t spread) {
+	std::vector<std::array<std::uint16_t, word_size>> pool(pool_size);
+	for (auto& word : pool) {
+		for (auto& entry : word) {
+			// Mostly small IDs, some of them flipped, as in real layers.
+			entry = gsl::narrow_cast<std::uint16_t>(random() % 64 | (random() % 8 == 0 ? horizontal_flip_flag : 0));
+		}
+	}
+	level_file_context level;
+	level.layer = grid<std::uint16_t>(size, word_size);
+	std::size_t word_index = 0;
+	for (std::size_t y = 0; y != size.height; y++) {
+		const auto row = level.layer.row(y);
+		for (std::size_t x = 0; x < size.width; x += word_size) {
+			const auto& word = pool[random() % std::min(word_index++ / spread + 1, pool_size)];
+			for (std::size_t i = 0; i != word_size && x + i != size.width; i++) {
+				row[x + i] = word[i];
+			}
+		}
+	}
+	return level;
+}
+
+// A layer of 64 words a row with count distinct nonempty words, followed by empty ones.
+level_file_context make_distinct_words(std::size_t count) {
+	level_file_context level;
+	level.layer = grid<std::uint16_t>({256, 1024}, word_size);
+	const auto entries = level.layer.elements();
+	for (std::size_t word = 0; word != count; word++) {
+		entries[word * word_size] = gsl::narrow_cast<std::uint16_t>((word + 1) & 0xffff);
+		entries[word * word_size + 1] = gsl::narrow_cast<std::uint16_t>((word + 1) >> 16);
+	}
+	return level;
+}
+
+bool same_words(const level_words& lhs, const level_words& rhs) {
+	return lhs.dictionary == rhs.dictionary && lhs.words == rhs.words;
+}
+
+}
+
+int main() {
+	std::mt19937 random(2018);
+	int failures = 0;
+	int checks = 0;
+	struct layer_case {
+		grid_size size;
+		std::size_t pool_size;
+		std::size_t spread;
+	};
+	const layer_case cases[] {
+		{{37, 300}, 50, 1},
+		{{37, 300}, 2000, 1},
+		{{250, 400}, 5000, 4},
+		// Fewer rows than threads.
+		{{10, 3}, 4, 1},
+		{{1, 1}, 1, 1},
+	};
+	for (const auto& layer : cases) {
+		const level_file_context level = make_level(random, layer.size, layer.pool_size, layer.spread);
+		const level_words expected = number_words(level);
+		for (const unsigned thread_count : {1u, 2u, 3u, 4u, 7u, 16u}) {
+			if (!same_words(make_level_words(level, thread_count), expected)) {
+				std::cerr << "The words of a " << layer.size.width << 'x' << layer.size.height << " layer differ with ";
+				std::cerr << thread_count << " threads" << std::endl;
+				failures++;
+			}
+			checks++;
+		}
+	}
+	// With the empty word, max_words words fit, and one more does not.
+	for (const unsigned thread_count : {1u, 5u}) {
+		const level_file_context full = make_distinct_words(max_words - 1);
+		const level_words words = make_level_words(full, thread_count);
+		failures += words.dictionary.size() != max_words || !same_words(words, number_words(full));
+		bool thrown = false;
+		try {
+			make_level_words(make_distinct_words(max_words), thread_count);
+		} catch (const tile_dictionary_full&) {
+			thrown = true;
+		}
+		if (!thrown) {
+			std::cerr << "A level of " << max_words + 1 << " distinct words was accepted with ";
+			std::cerr << thread_count << " threads" << std::endl;
+			failures++;
+		}
+		checks += 2;
+	}
+	if (failures != 0) {
+		std::cerr << failures << " of " << checks << " word dictionary checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << checks << " word dictionaries match a single row-major pass" << std::endl;
+	return 0;
+}
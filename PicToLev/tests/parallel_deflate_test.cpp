@@ -0,0 +1,153 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Deflates inputs in pieces with lodepng_deflate_range and joins them into a
+// zlib stream whose Adler-32 is combined from those of the pieces with
+// lodepng_adler32_combine, then decompresses it, which verifies the checksum,
+// and compares the result with the input. Then checks that parallel_zlib_compress
+// gives the same bytes for any number of threads, and that they decompress to
+// the input. The sources are included, as the test script only links the
+// allocator.
+
+#include "../src/lodepng.cpp"
+#include "../src/parallel_deflate.cpp"
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+	// Random 64-byte runs, each repeated a random number of times, like tile rows.
+	std::vector<unsigned char> make_input(std::size_t size, std::mt19937& random) {
+		std::vector<unsigned char> input;
+		input.reserve(size);
+		while (input.size() < size) {
+			unsigned char run[64];
+			for (auto& value : run) {
+				value = random() % 4 == 0 ? static_cast<unsigned char>(random()) : 0;
+			}
+			for (unsigned repeat = random() % 8; repeat != 0 && input.size() < size; repeat--) {
+				input.insert(input.end(), run, run + std::min<std::size_t>(64, size - input.size()));
+			}
+		}
+		return input;
+	}
+
+	// Whether the zlib stream decompresses to the input.
+	bool decompresses_to(const std::vector<unsigned char>& stream, const std::vector<unsigned char>& input) {
+		unsigned char* out = nullptr;
+		std::size_t outsize = 0;
+		LodePNGDecompressSettings settings;
+		lodepng_decompress_settings_init(&settings);
+		const unsigned error = lodepng_zlib_decompress(&out, &outsize, stream.data(), stream.size(), &settings);
+		const bool equal = error == 0 && outsize == input.size() && std::equal(input.begin(), input.end(), out);
+		lodepng_free(out);
+		return equal;
+	}
+
+	// Deflates the input in piece_count pieces and joins them into a zlib stream
+	// with the combined Adler-32 of the pieces, which the decompressor verifies.
+	// Returns false if a call fails or the stream does not decompress to the input.
+	bool check_pieces(const std::vector<unsigned char>& input, std::size_t piece_count, const LodePNGCompressSettings& settings) {
+		const std::size_t piece_size = (input.size() + piece_count - 1) / piece_count;
+		std::vector<unsigned char> stream {0x78, 0x01};
+		unsigned adler = 1;
+		for (std::size_t i = 0; i != piece_count; i++) {
+			const std::size_t start = std::min(i * piece_size, input.size());
+			const std::size_t end = i + 1 == piece_count ? input.size() : std::min(start + piece_size, input.size());
+			unsigned char* piece = nullptr;
+			std::size_t piece_length = 0;
+			const unsigned error = lodepng_deflate_range(&piece, &piece_length, input.data(), input.size(), start, end, &settings);
+			if (error == 0)
+				stream.insert(stream.end(), piece, piece + piece_length);
+			lodepng_free(piece);
+			if (error != 0)
+				return false;
+			adler = lodepng_adler32_combine(adler, lodepng_update_adler32(1, input.data() + start, end - start), end - start);
+		}
+		for (int shift = 24; shift >= 0; shift -= 8) {
+			stream.push_back(static_cast<unsigned char>(adler >> shift));
+		}
+		return decompresses_to(stream, input);
+	}
+
+	// Compresses the input with parallel_zlib_compress on thread_count threads.
+	std::vector<unsigned char> compress(const std::vector<unsigned char>& input, unsigned thread_count, LodePNGCompressSettings settings) {
+		const parallel_deflate_options options {thread_count, 4096};
+		settings.custom_context = &options;
+		unsigned char* out = nullptr;
+		std::size_t outsize = 0;
+		std::vector<unsigned char> result;
+		if (parallel_zlib_compress(&out, &outsize, input.data(), input.size(), &settings) == 0)
+			result.assign(out, out + outsize);
+		lodepng_free(out);
+		return result;
+	}
+}
+
+int main() {
+	std::mt19937 random(2018);
+	std::vector<LodePNGCompressSettings> settings(4);
+	for (auto& setting : settings) {
+		lodepng_compress_settings_init(&setting);
+	}
+	settings[0].btype = 0;
+	settings[1].btype = 1;
+	settings[3].windowsize = 32768;
+	settings[3].maxchainlength = 64;
+	int failures = 0;
+	int checks = 0;
+	for (const std::size_t size : {0, 1, 100, 5000, 70000, 300000}) {
+		const auto input = make_input(size, random);
+		for (std::size_t s = 0; s != settings.size(); s++) {
+			for (const std::size_t piece_count : {1, 2, 3, 7}) {
+				if (!check_pieces(input, piece_count, settings[s])) {
+					std::cerr << size << " bytes in " << piece_count << " pieces with settings " << s;
+					std::cerr << " do not round-trip" << std::endl;
+					failures++;
+				}
+				checks++;
+			}
+			const auto expected = compress(input, 1, settings[s]);
+			if (!decompresses_to(expected, input)) {
+				std::cerr << size << " bytes with settings " << s << " do not round-trip through parallel_zlib_compress" << std::endl;
+				failures++;
+			}
+			for (const unsigned thread_count : {2, 3, 8}) {
+				if (compress(input, thread_count, settings[s]) != expected) {
+					std::cerr << size << " bytes with settings " << s << " compress differently on ";
+					std::cerr << thread_count << " threads than on one" << std::endl;
+					failures++;
+				}
+				checks++;
+			}
+		}
+	}
+	if (failures != 0) {
+		std::cerr << failures << " of " << checks << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << checks << " checks passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,41 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Includes every source file of PicToLev, with its main function renamed, so
+// that a test can reach the functions of main.cpp. The test script only links
+// lodepng_arena.cpp, which is therefore left out.
+
+#ifndef PICTOLEV_TESTS_PICTOLEV_SOURCES_H
+#define PICTOLEV_TESTS_PICTOLEV_SOURCES_H
+
+#include "../src/compression_level.cpp"
+#include "../src/lodepng.cpp"
+#include "../src/mapped_file.cpp"
+#include "../src/parallel_deflate.cpp"
+#include "../src/uniform_rows.cpp"
+#define main pictolev_main
+#include "../src/main.cpp"
+#undef main
+
+#endif
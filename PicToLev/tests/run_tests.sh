@@ -0,0 +1,15 @@
+#!/bin/sh
+# Builds and runs every *_test.cpp in this directory with the compiler in CXX.
+# The tests include the sources they check themselves and link lodepng_arena.cpp
+# for its allocators.
+set -e
+cd "$(dirname "$0")"
+CXX=${CXX:-c++}
+BUILD_DIR=${BUILD_DIR:-${TMPDIR:-/tmp}/pictolev-tests}
+mkdir -p "$BUILD_DIR"
+for test in *_test.cpp; do
+	name=${test%.cpp}
+	echo "== $name"
+	$CXX -std=c++17 -O2 -Wall -Wextra -pthread -I../include $CXXFLAGS "$test" ../src/lodepng_arena.cpp -o "$BUILD_DIR/$name"
+	"$BUILD_DIR/$name"
+done
@@ -0,0 +1,198 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Checks that the four mirror images of a tile get one tileset tile when flips
+// are on, with layer entries whose flip flags turn the stored tile back into
+// each source tile, and that tiles symmetric under a flip get no flags for it.
+
+#include "pictolev_sources.h"
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t strip_width = tile_flip_count * tileset_tile_size;
+// Stands for tiles symmetric under turning them half a turn, but under neither flip alone.
+constexpr unsigned half_turn_symmetry = tile_flip_count;
+
+// A strip of the four mirror images of a tile, in flip order, for every plane.
+struct mirror_strip {
+	std::vector<unsigned char> planes[image_count];
+	tile_t tile(unsigned flip) const {
+		tile_t tile;
+		for (gsl::index i = 0; i < image_count; i++) {
+			gsl::at(tile, i) = image_t(gsl::at(planes, i).data() + flip * tileset_tile_size, strip_width);
+		}
+		return tile;
+	}
+};
+
+// Makes the mirror images of a random tile. The colours come from a few values
+// so that the planes are neither uniform nor easily told apart by their first
+// rows, and the mask is binary like the masks PicToLev reads. The tile is then
+// made symmetric under the flips in symmetry, or half_turn_symmetry.
+mirror_strip make_strip(std::mt19937& random, unsigned colours, unsigned symmetry) {
+	mirror_strip strip;
+	for (gsl::index i = 0; i < image_count; i++) {
+		unsigned char source[tileset_tile_size][tileset_tile_size];
+		const unsigned values = i == 0 ? colours : 2;
+		for (auto& row : source) {
+			for (auto& pixel : row) {
+				pixel = static_cast<unsigned char>(random() % values);
+			}
+		}
+		for (std::size_t y = 0; y != tileset_tile_size; y++) {
+			for (std::size_t x = 0; x != tileset_tile_size; x++) {
+				const std::size_t mirror_x = tileset_tile_size - 1 - x;
+				const std::size_t mirror_y = tileset_tile_size - 1 - y;
+				if (symmetry == half_turn_symmetry) {
+					source[mirror_y][mirror_x] = source[y][x];
+					continue;
+				}
+				if (symmetry & horizontal_flip)
+					source[y][mirror_x] = source[y][x];
+				if (symmetry & vertical_flip)
+					source[mirror_y][x] = source[y][x];
+			}
+		}
+		auto& plane = gsl::at(strip.planes, i);
+		plane.resize(strip_width * tileset_tile_size);
+		for (unsigned flip = no_flip; flip != tile_flip_count; flip++) {
+			for (std::size_t y = 0; y != tileset_tile_size; y++) {
+				for (std::size_t x = 0; x != tileset_tile_size; x++) {
+					const std::size_t source_x = flip & horizontal_flip ? tileset_tile_size - 1 - x : x;
+					const std::size_t source_y = flip & vertical_flip ? tileset_tile_size - 1 - y : y;
+					plane[y * strip_width + flip * tileset_tile_size + x] = source[source_y][source_x];
+				}
+			}
+		}
+	}
+	return strip;
+}
+
+unsigned entry_flip(std::uint16_t entry) {
+	return (entry & horizontal_flip_flag ? horizontal_flip : no_flip) | (entry & vertical_flip_flag ? vertical_flip : no_flip);
+}
+
+unsigned entry_id(std::uint16_t entry) {
+	return entry & ~(horizontal_flip_flag | vertical_flip_flag);
+}
+
+// The tile with the given ID in the tileset images.
+tile_t tileset_tile(const output_contexts& outputs, unsigned id) {
+	constexpr std::size_t tileset_row_size = grid_area({tileset_image_width, tileset_tile_size});
+	const std::size_t offset = id / tileset_width * tileset_row_size + id % tileset_width * tileset_tile_size;
+	tile_t tile;
+	for (gsl::index i = 0; i < image_count; i++) {
+		gsl::at(tile, i) = image_t(gsl::at(outputs, i).buffer.data() + offset, tileset_image_width);
+	}
+	return tile;
+}
+
+bool equal_flipped(const tile_t& lhs, const tile_t& rhs, unsigned flip) {
+	for (gsl::index i = 0; i < image_count; i++) {
+		if (!equal_flipped(gsl::at(lhs, i), gsl::at(rhs, i), flip))
+			return false;
+	}
+	return true;
+}
+
+}
+
+int main() {
+	std::mt19937 random(2018);
+	tile_t empty_tile;
+	empty_tile.fill(image_t(empty_tile_row, 0));
+	tile_dictionary_t tiles(max_tiles + 1);
+	tiles.emplace({empty_tile, no_flip}, keep_tile);
+	output_contexts outputs;
+	init_tileset_images(outputs);
+	const auto store = [&](const tile_key& key, std::size_t id) { return store_tile(outputs, key, id); };
+	uniform_tile_ids uniform_ids;
+	tile_path_stats stats;
+	int failures = 0;
+	int checks = 0;
+	const unsigned symmetries[] {no_flip, horizontal_flip, vertical_flip, horizontal_flip | vertical_flip, half_turn_symmetry};
+	for (const unsigned symmetry : symmetries) {
+		// One colour gives a uniform colour plane under a general mask.
+		for (const unsigned colours : {1u, 2u, 4u, 256u}) {
+			for (int round = 0; round != 20; round++) {
+				const mirror_strip strip = make_strip(random, colours, symmetry);
+				const std::size_t size = tiles.values().size();
+				std::uint16_t entries[tile_flip_count];
+				for (unsigned flip = no_flip; flip != tile_flip_count; flip++) {
+					entries[flip] = resolve_tile(tiles, uniform_ids, strip.tile(flip), true, store, stats);
+				}
+				// One tile at most was added for all four mirror images.
+				failures += tiles.values().size() > size + 1;
+				const unsigned id = entry_id(entries[no_flip]);
+				const tile_t stored = tileset_tile(outputs, id);
+				const tile_key canonical = make_tile_key(strip.tile(no_flip), true);
+				for (unsigned flip = no_flip; flip != tile_flip_count; flip++) {
+					const tile_t source = strip.tile(flip);
+					const tile_key key = make_tile_key(source, true);
+					failures += !oriented_tile_equal()(key, canonical);
+					failures += oriented_tile_hash()(key) != oriented_tile_hash()(canonical);
+					failures += entry_id(entries[flip]) != id;
+					// The flags rebuild the source tile from the stored one.
+					failures += !equal_flipped(source, stored, entry_flip(entries[flip]));
+					// Mirror images differ by the flip between them.
+					failures += !equal_flipped(source, stored, entry_flip(entries[no_flip]) ^ flip);
+					// A source identical to the stored tile needs no flags.
+					failures += equal_flipped(source, stored, no_flip) && entry_flip(entries[flip]) != no_flip;
+					checks++;
+				}
+				// A tile symmetric under a flip has no flags for it, so the
+				// entries of its mirror images do not depend on that flip.
+				if (symmetry != half_turn_symmetry) {
+					for (unsigned flip = no_flip; flip != tile_flip_count; flip++) {
+						failures += entries[flip] != entries[flip & ~symmetry];
+						failures += (entry_flip(entries[flip]) & symmetry) != no_flip;
+					}
+				}
+				else {
+					failures += entries[horizontal_flip | vertical_flip] != entries[no_flip];
+					failures += entries[vertical_flip] != entries[horizontal_flip];
+				}
+			}
+		}
+	}
+	// Without flips, every distinct mirror image is a tile of its own.
+	const mirror_strip strip = make_strip(random, 256, no_flip);
+	for (unsigned flip = no_flip; flip != tile_flip_count; flip++) {
+		const std::size_t size = tiles.values().size();
+		const std::uint16_t entry = resolve_tile(tiles, uniform_ids, strip.tile(flip), false, store, stats);
+		failures += tiles.values().size() != size + 1 || entry != size;
+		checks++;
+	}
+	std::cout << checks << " mirror images checked, " << tiles.values().size() << " distinct tiles" << std::endl;
+	if (failures != 0) {
+		std::cerr << failures << " checks of flipped tiles failed" << std::endl;
+		return 1;
+	}
+	std::cout << "Every mirror image maps to one stored tile with the right flip flags" << std::endl;
+	return 0;
+}
@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Checks every unfilterScanlineFast variant the CPU supports against
+// unfilterScanlineScalar, for all filter types and 1 to 8 bytes per pixel, on
+// random scanlines. lodepng.cpp is included to reach its internal functions.
+
+#include "../src/lodepng.cpp"
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+	struct feature_set {
+		const char* name;
+		unsigned features;
+	};
+
+	const feature_set feature_sets[] = {
+		{"portable", 0},
+		{"SSE2", LODEPNG_CPU_SSE2},
+		{"SSE2+AVX2", LODEPNG_CPU_SSE2 | LODEPNG_CPU_AVX2},
+	};
+
+	// Returns the number of mismatches of one variant on one scanline, unfiltered
+	// both into a separate buffer and in place, like unfilter does.
+	int check_scanline(const feature_set& set, const std::vector<unsigned char>& scanline,
+		const std::vector<unsigned char>* precon, std::size_t bytewidth, unsigned char filter_type) {
+		const std::size_t length = scanline.size();
+		const unsigned char* precon_data = precon ? precon->data() : nullptr;
+		std::vector<unsigned char> expected(length);
+		if (unfilterScanlineScalar(expected.data(), scanline.data(), precon_data, bytewidth, filter_type, length) != 0)
+			return 1;
+		int failures = 0;
+		std::vector<unsigned char> separate(length);
+		std::vector<unsigned char> in_place = scanline;
+		const unsigned char* outputs[] = {separate.data(), in_place.data()};
+		unsigned char* recons[] = {separate.data(), in_place.data()};
+		const unsigned char* sources[] = {scanline.data(), in_place.data()};
+		for (int i = 0; i != 2; i++) {
+			if (!unfilterScanlineFast(recons[i], sources[i], precon_data, bytewidth, filter_type, length, set.features))
+				continue;
+			if (!std::equal(expected.begin(), expected.end(), outputs[i])) {
+				std::cerr << set.name << ": filter " << int(filter_type) << ", " << bytewidth << " bytes per pixel, ";
+				std::cerr << length << " bytes" << (precon ? "" : " without previous scanline");
+				std::cerr << (i == 0 ? "" : " in place") << " differs from the scalar version" << std::endl;
+				failures++;
+			}
+		}
+		return failures;
+	}
+}
+
+int main() {
+	std::mt19937 random(12345);
+	std::uniform_int_distribution<int> byte(0, 255);
+	const unsigned supported = lodepng_cpu_features();
+	int failures = 0;
+	for (const auto& set : feature_sets) {
+		if ((set.features & supported) != set.features) {
+			std::cout << set.name << ": not supported by this CPU, skipped" << std::endl;
+			continue;
+		}
+		int checks = 0;
+		for (std::size_t bytewidth = 1; bytewidth <= 8; bytewidth++) {
+			for (unsigned char filter_type = 0; filter_type <= 4; filter_type++) {
+				for (int row = 0; row != 200; row++) {
+					// Short rows exercise the tails, long ones the vector loops.
+					const std::size_t pixels = 1 + random() % (row < 100 ? 20 : 300);
+					std::vector<unsigned char> scanline(pixels * bytewidth);
+					std::vector<unsigned char> precon(pixels * bytewidth);
+					for (auto& value : scanline) {
+						value = static_cast<unsigned char>(byte(random));
+					}
+					for (auto& value : precon) {
+						value = static_cast<unsigned char>(byte(random));
+					}
+					failures += check_scanline(set, scanline, &precon, bytewidth, filter_type);
+					failures += check_scanline(set, scanline, nullptr, bytewidth, filter_type);
+					checks += 2;
+				}
+			}
+		}
+		std::cout << set.name << ": " << checks << " scanlines checked" << std::endl;
+	}
+	if (failures != 0) {
+		std::cerr << failures << " mismatches" << std::endl;
+		return 1;
+	}
+	std::cout << "All unfilter variants match the scalar version" << std::endl;
+	return 0;
+}
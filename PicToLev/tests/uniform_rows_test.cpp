@@ -0,0 +1,84 @@
+////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2018 Sir Ementaler
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+////////////////////////////////////////////////////////////
+
+// Checks uniform_rows and is_uniform on uniform blocks of every value and row
+// size up to 40, with every single byte changed in turn, in a strided image.
+// uniform_rows.cpp is included, as the test script only links the allocator.
+
+#include "../src/uniform_rows.cpp"
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "tiles.h"
+
+int main() {
+	constexpr std::size_t stride = 100;
+	constexpr std::size_t row_count = 8;
+	std::mt19937 random(2018);
+	std::vector<unsigned char> image(stride * row_count);
+	int failures = 0;
+	int checks = 0;
+	for (std::size_t row_size = 1; row_size <= 40; row_size++) {
+		for (unsigned value = 0; value < 256; value += 51) {
+			const std::size_t offset = random() % (stride - row_size + 1);
+			for (auto& byte : image) {
+				byte = static_cast<unsigned char>(random());
+			}
+			for (std::size_t y = 0; y != row_count; y++) {
+				std::fill_n(&image[y * stride + offset], row_size, static_cast<unsigned char>(value));
+			}
+			const unsigned char* block = &image[offset];
+			const auto uniform = static_cast<unsigned char>(value);
+			failures += !uniform_rows(block, stride, row_count, row_size, uniform);
+			for (std::size_t y = 0; y != row_count; y++) {
+				for (std::size_t x = 0; x != row_size; x++) {
+					unsigned char& byte = image[y * stride + offset + x];
+					byte ^= 1 << (random() % 8);
+					failures += uniform_rows(block, stride, row_count, row_size, uniform);
+					byte = uniform;
+					checks++;
+				}
+			}
+		}
+	}
+	std::cout << checks << " blocks checked" << std::endl;
+	// A 32x32 tile of a wider image, as PicToLev classifies them.
+	std::vector<unsigned char> level(96 * 32, 7);
+	const tile_view<const unsigned char, 32> tile(&level[32], 96);
+	unsigned char value;
+	failures += !is_uniform(tile, value) || value != 7;
+	level[31 * 96 + 63] = 8;
+	failures += is_uniform(tile, value);
+	level[31 * 96 + 64] = 9;
+	level[31 * 96 + 63] = 7;
+	failures += !is_uniform(tile, value);
+	if (failures != 0) {
+		std::cerr << failures << " blocks were classified wrongly" << std::endl;
+		return 1;
+	}
+	std::cout << "uniform_rows and is_uniform agree with the expected results" << std::endl;
+	return 0;
+}